@@ -0,0 +1,7 @@
+
+# Times ray queries against the triangle BVHs of a couple of the bundled models, one ray at a time and spread over
+# the worker pool, and reports millions of rays per second. Run again after changing the BVH or its traversal.
+g++ -O2 ./src/raycast_bench.cpp ./src/bvh.cpp ./src/workers.cpp -I ./assimp/include -I ./glm -I ./include \
+        -o ./build/raycast_bench -lassimp -lpthread
+
+./build/raycast_bench ./assets/terrain.obj ./assets/vase.obj
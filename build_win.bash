@@ -1,9 +1,9 @@
 # FILES=$(find | grep ".cpp$")
 # g++ ${FILES} -o program -I ./glad/include  -lmingw32 -lSDL2main -lSDL2
 # ./preprocessor.bash
-g++ src/stb_image.cpp src/texture.cpp src/utilities.cpp src/pipeline.cpp src/serialise.cpp \
+g++ src/stb_image.cpp src/texture.cpp src/texture_streamer.cpp src/residency.cpp src/texture_array.cpp src/material_table.cpp src/render_graph.cpp src/dynamic_resolution.cpp src/profiler.cpp src/utilities.cpp src/pipeline.cpp src/serialise.cpp \
         src/scene_node.cpp src/scene.cpp src/fbo.cpp src/directional_light.cpp \
-        src/parse_types.cpp src/application.cpp src/transform.cpp src/mesh.cpp src/camera.cpp src/main.cpp glad/src/glad.c \
+        src/parse_types.cpp src/application.cpp src/transform.cpp src/mesh.cpp src/camera.cpp src/bvh.cpp src/workers.cpp src/clusters.cpp src/reflection_probe.cpp src/main.cpp glad/src/glad.c \
         -o build/program \
         -I ./assimp/include/ -I ./glad/include -I ./glm -I ./include \
         -lmingw32 -lSDL2main -lSDL2 -lassimp \
@@ -0,0 +1,11 @@
+
+# Cooks the images in ./assets/ into mipmapped, block compressed .ktx files beside them, which texture::load
+# uploads in their place. Run again whenever an image changes.
+g++ -O2 ./src/texture_cooker.cpp ./src/stb_image.cpp -I ./include -o ./build/texture_cooker
+
+# The water maps hold vectors rather than colours, and the noise texture is left as it is
+data_files=(./assets/dudv.png ./assets/normal.png)
+colour_files=$(find ./assets -type f \( -name "*.png" -o -name "*.jpg" \) \
+        ! -name "dudv.*" ! -name "normal.*" ! -name "noise.png")
+
+./build/texture_cooker ${colour_files} --linear "${data_files[@]}"
@@ -6,23 +6,74 @@
 #include <chrono>
 #include <string>
 #include <optional>
+#include <unordered_map>
 
 #include "pipeline.h"
 #include "scene.h"
 #include "scene_node.h"
 #include "utilities.h"
 #include "fbo.h"
+#include "clusters.h"
+#include "render_graph.h"
+#include "dynamic_resolution.h"
+#include "profiler.h"
 
 struct camera;
 struct directional_light;
 struct point_light;
 struct texture;
 struct renderer;
+struct reflection_probe;
 
 #define DEFAULT_WIDTH 1920
 #define DEFAULT_HEIGHT 1080
 #define DEFAULT_ASPECT DEFAULT_WIDTH / (DEFAULT_HEIGHT * 1.0f)
 
+#define WINDOW_TITLE "Little Engine"
+
+// With camera::m_profiler_overlay set, the window's title shows the pass timings, rewritten this often to stay readable
+#define PROFILER_OVERLAY_FRAMES 30
+
+// Render paths, selected by camera::m_render_path
+#define RENDER_PATH_FORWARD 0
+#define RENDER_PATH_DEFERRED 1
+
+// Depth pre-pass modes, selected by camera::m_depth_prepass. In auto mode the pre-pass is switched on when
+// the lighting pass shades more than DEPTH_PREPASS_ENABLE_OVERDRAW fragments per pixel, and back off once
+// that falls under DEPTH_PREPASS_DISABLE_OVERDRAW
+#define DEPTH_PREPASS_OFF 0
+#define DEPTH_PREPASS_ON 1
+#define DEPTH_PREPASS_AUTO 2
+
+#define DEPTH_PREPASS_ENABLE_OVERDRAW 1.6f
+#define DEPTH_PREPASS_DISABLE_OVERDRAW 1.3f
+
+// Water surfaces within this height of each other are treated as one plane, sharing a reflection
+#define WATER_PLANE_TOLERANCE 0.01f
+
+// The nearest visible water plane gets a full size reflection; the rest get one scaled down by this much
+#define WATER_SECONDARY_REFLECTION_DIVISOR 2
+
+// Water reflection modes, selected by camera::m_water_reflection. Planar reflections redraw the scene mirrored
+// in the water; screen-space reflections trace the main view instead, and fall back to the nearby reflection
+// probes, or the sky, where that misses; probe reflections only look up the probes. These must match water.fs.
+#define WATER_REFLECTION_PLANAR 0
+#define WATER_REFLECTION_SCREEN_SPACE 1
+#define WATER_REFLECTION_PROBE 2
+
+// Upscaling filters, selected by camera::m_upscale_filter, for when the view is drawn below the window's resolution
+#define UPSCALE_BILINEAR 0
+#define UPSCALE_CATMULL_ROM 1
+
+// Screen-space reflections march through this many levels of depth pyramid, the first at half the view's size
+#define DEPTH_PYRAMID_LEVELS 5
+
+// Overdraw is measured with occlusion queries, which are read back a few frames late rather than stalling
+#define OVERDRAW_QUERIES 3
+
+// Shadow casters that haven't moved for this many frames are drawn into the cached static shadow maps
+#define SHADOW_STATIC_FRAMES 30
+
 struct application {
     private:
         int m_window_width { DEFAULT_WIDTH };
@@ -36,10 +87,109 @@ struct application {
         pipeline m_lightpipeline {};
         pipeline m_shadowpipeline {};
         pipeline m_waterpipeline {};
+        pipeline m_gbufferpipeline {};
+        pipeline m_deferredpipeline {};
+        pipeline m_depthpipeline {};
+        pipeline m_reflectionpipeline {};
+        pipeline m_depthpyramidpipeline {};
+        pipeline m_upscalepipeline {};
 
+        // Static casters are cached in m_static_shadowmap; moving casters are drawn over a copy of it, in
+        // m_shadowmap, which is only created once something in the scene moves
+        fbo m_static_shadowmap {};
         fbo m_shadowmap {};
-        fbo m_reflectionmap {};
-        fbo m_refractionmap {};
+        bool m_shadow_dynamic { false };
+
+        struct shadow_caster_state {
+            glm::mat4 model_mat { 1.0f };
+            unsigned int moved_frame { 0 };
+            bool dynamic { false };
+        };
+
+        std::unordered_map<scene_node*, shadow_caster_state> m_shadow_casters {};
+        unsigned int m_static_casters_revision { 1 };
+        int m_static_caster_count { 0 };
+
+        // Cascade state persists between frames, since cascades after the first aren't redrawn every frame
+        std::vector<glm::mat4> m_cascade_matrices {};
+        std::vector<float> m_cascade_splits {};
+        std::vector<bool> m_cascade_valid {};
+        std::vector<unsigned int> m_cascade_static_revision {};
+        std::vector<bool> m_cascade_dynamic {};
+        std::vector<bool> m_cascade_composited {};
+        unsigned int m_cascade_light_revision { 0 };
+        unsigned int m_frame { 0 };
+
+        // Every water body at the same height shares one reflection, and one visibility test
+        struct water_plane {
+            float height { 0.0f };
+            std::vector<scene_node*> bodies {};
+
+            // The reflection is only redrawn every few frames; the water reprojects it with the matrix it was drawn with
+            fbo reflection_map {};
+            glm::mat4 reflection_matrix { 1.0f };
+            unsigned int reflection_frame { 0 };
+            bool reflection_valid { false };
+
+            // Occlusion query against the main view's depth, read back a frame late
+            GLuint query { 0 };
+            bool query_pending { false };
+            bool occluded { false };
+
+            // Distance to the nearest body, for prioritising reflection resolution
+            float distance { 0.0f };
+
+            // Bodies inside this frame's frustum, which the occlusion query draws
+            std::vector<scene_node*> in_frustum {};
+
+            void destroy() {
+                reflection_map.destroy();
+                if (query) glDeleteQueries(1, &query);
+                query = 0;
+            }
+        };
+
+        std::vector<water_plane> m_water_planes {};
+
+        // Rebuilt every frame; the camera's view is drawn into its main view target, with a floating point depth buffer
+        // for reversed-Z, then copied to the window
+        render_graph m_graph {};
+
+        // What the frame being built is drawn from, for the passes registered with the graph
+        struct frame_state {
+            camera* cam { nullptr };
+            std::vector<directional_light*> d_lights {};
+            std::vector<point_light*> p_lights {};
+            glm::mat4 view_mat { 1.0f };
+            glm::mat4 proj_mat { 1.0f };
+        };
+
+        frame_state m_frame_state {};
+
+        // Every pass is timed, and the view is drawn at the window's size scaled to keep the GPU's time on target,
+        // then upscaled into the window
+        gpu_profiler m_profiler {};
+        bool m_profiler_overlay_shown { false };
+
+        resolution_controller m_resolution {};
+        int m_render_width { DEFAULT_WIDTH };
+        int m_render_height { DEFAULT_HEIGHT };
+
+        GLuint m_empty_vao { 0 };
+
+        // Depth pre-pass state; WebGL has no GL_SAMPLES_PASSED query, so auto mode never enables it there
+        bool m_depth_prepass_active { false };
+        float m_overdraw { 0.0f };
+        GLuint m_overdraw_queries[OVERDRAW_QUERIES] {};
+        bool m_overdraw_query_pending[OVERDRAW_QUERIES] {};
+        int m_overdraw_query_index { 0 };
+
+        // Point lights binned for the main view, and for the reflected view under the water
+        light_clusters m_clusters {};
+        light_clusters m_reflection_clusters {};
+
+        // Reflection probe faces are drawn here, then copied into the probe's cubemap
+        fbo m_probe_capture {};
 
         texture* m_noise_texture { nullptr };
         texture* m_dudv_texture { nullptr };
@@ -58,14 +208,70 @@ struct application {
         
         float calc_program_time();
 
-        void render_lighting(camera* cam, std::vector<directional_light*>& d_lights, std::vector<point_light*>& p_lights,
-                        glm::mat4& view_mat, glm::mat4& proj_mat, glm::mat4& shadow_mat, bool external_setup = false);
+        glm::vec3 sky_colour();
+
+        // Switch between reversed-Z, used for everything seen from the camera, and conventional depth for shadow maps
+        void use_reversed_depth(bool reversed);
+
+        // The shader features a lighting pass needs, leaving out shadows and point lights when there are none
+        unsigned int lighting_features(camera* cam, light_clusters& clusters);
+
+        void set_lighting_uniforms(pipeline& p, camera* cam, std::vector<directional_light*>& d_lights, light_clusters& clusters,
+                        glm::mat4& view_mat, glm::mat4& proj_mat);
+
+        void render_lighting(camera* cam, std::vector<directional_light*>& d_lights, light_clusters& clusters,
+                        glm::mat4& view_mat, glm::mat4& proj_mat, fbo& target);
+
+        bool use_depth_prepass(camera* cam);
+
+        bool begin_overdraw_query();
+
+        void render_gbuffer(glm::mat4& view_mat, glm::mat4& proj_mat, fbo& gbuffer);
+
+        void render_deferred(camera* cam, std::vector<directional_light*>& d_lights, light_clusters& clusters,
+                        glm::mat4& view_mat, glm::mat4& proj_mat, fbo& gbuffer, fbo& target);
 
         void render_shadows(camera* cam, std::vector<directional_light*>& d_lights, std::vector<point_light*>& p_lights, 
-                        glm::mat4& shadow_mat);
+                        glm::mat4& view_mat);
+
+        void classify_shadow_casters(std::vector<scene_node*>& renderers);
 
-        void render_water(camera* cam, std::vector<directional_light*>& d_lights, std::vector<point_light*>& p_lights,
-                      glm::mat4& view_mat, glm::mat4& proj_mat, glm::mat4& shadow_mat, renderer* water);
+        void gather_water_planes();
+
+        // Frustum test, and the last occlusion query's result if it has arrived
+        bool water_visible(water_plane& plane, glm::mat4& view_mat, glm::mat4& proj_mat);
+
+        void query_water_occlusion(water_plane& plane, glm::mat4& view_mat, glm::mat4& proj_mat, fbo& target);
+
+        // Tells the residency manager how large each visible renderer's textures appear, then fits them to the budget
+        void update_residency(camera* cam, glm::mat4& view_mat, glm::mat4& proj_mat);
+
+        void render_reflection(camera* cam, std::vector<directional_light*>& d_lights, std::vector<point_light*>& p_lights,
+                        glm::mat4& proj_mat, water_plane& plane);
+
+        // Nearest depth of each block of the source's depth, for screen-space reflections
+        void build_depth_pyramid(fbo& source, fbo& pyramid);
+
+        // Captures every reflection probe that doesn't have a cubemap yet, and caches the result if it can
+        void update_reflection_probes(camera* cam, std::vector<directional_light*>& d_lights, std::vector<point_light*>& p_lights);
+
+        void capture_reflection_probe(camera* cam, std::vector<directional_light*>& d_lights, std::vector<point_light*>& p_lights,
+                        reflection_probe& probe);
+
+        void render_water_reflections(camera* cam, std::vector<directional_light*>& d_lights, std::vector<point_light*>& p_lights,
+                        glm::mat4& proj_mat, std::vector<water_plane*>& visible);
+
+        // The depth pyramid is only given for screen-space reflections
+        void render_water(camera* cam, std::vector<directional_light*>& d_lights, glm::mat4& view_mat, glm::mat4& proj_mat,
+                      std::vector<water_plane*>& visible, fbo& target, fbo& refraction, fbo* depth_pyramid);
+
+        // Copies the view into the window, filtered by the camera's upscaling filter if it's smaller
+        void present(camera* cam, fbo& view);
+
+        // The application's own passes that aren't part of every frame's spine, added through the graph's stages
+        void register_passes();
+
+        void update_profiler_overlay(camera* cam);
         
     public:
         const float desired_fps = 1 / 60.0f;
@@ -105,6 +311,9 @@ struct application {
 
         scene* current_scene();
 
+        // Systems register the passes they add to each frame here
+        render_graph& graph() { return m_graph; }
+
         void quit() { m_quitting = true; }
 
         inline bool quitting() { return m_quitting; }
@@ -0,0 +1,75 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <limits>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/common.hpp>
+
+// Axis-aligned bounding box. Starts out empty (inverted), so that growing it by any point
+// or box yields exactly that point or box.
+struct aabb {
+    glm::vec3 min { std::numeric_limits<float>::max() };
+    glm::vec3 max { -std::numeric_limits<float>::max() };
+
+    inline void grow(glm::vec3 p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    inline void grow(const aabb& b) {
+        min = glm::min(min, b.min);
+        max = glm::max(max, b.max);
+    }
+
+    inline bool empty() const {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    inline glm::vec3 centre() const {
+        return (min + max) * 0.5f;
+    }
+
+    inline glm::vec3 extent() const {
+        return max - min;
+    }
+
+    inline float surface_area() const {
+        if (empty()) return 0.0f;
+        glm::vec3 e { extent() };
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    // Bounds of this box after an affine transformation, found by transforming its centre and
+    // projecting its half-extents onto the (absolute) axes of the matrix.
+    inline aabb transformed(const glm::mat4& m) const {
+        if (empty()) return *this;
+
+        glm::vec3 c { m * glm::vec4(centre(), 1.0f) };
+        glm::vec3 h { extent() * 0.5f };
+
+        glm::vec3 r {
+            glm::abs(m[0][0]) * h.x + glm::abs(m[1][0]) * h.y + glm::abs(m[2][0]) * h.z,
+            glm::abs(m[0][1]) * h.x + glm::abs(m[1][1]) * h.y + glm::abs(m[2][1]) * h.z,
+            glm::abs(m[0][2]) * h.x + glm::abs(m[1][2]) * h.y + glm::abs(m[2][2]) * h.z
+        };
+
+        return { c - r, c + r };
+    }
+
+    // Whether any of the box is on the positive side of the plane
+    inline bool reaches(const glm::vec4& plane) const {
+        glm::vec3 p { plane.x > 0.0f ? max.x : min.x, plane.y > 0.0f ? max.y : min.y, plane.z > 0.0f ? max.z : min.z };
+        return plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w >= 0.0f;
+    }
+
+    // Distance from a point to the nearest point of the box; zero inside it
+    inline float distance(glm::vec3 p) const {
+        glm::vec3 d { glm::max(glm::max(min - p, p - max), glm::vec3 { 0.0f }) };
+        return glm::sqrt(d.x * d.x + d.y * d.y + d.z * d.z);
+    }
+};
+
+#endif
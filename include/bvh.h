@@ -0,0 +1,179 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include <limits>
+#include <utility>
+
+#include <glm/vec3.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#   define BVH_SIMD 1
+#   include <xmmintrin.h>
+#endif
+
+#include "bounds.h"
+
+#define BVH_MAX_DEPTH 64
+#define BVH_SAH_BINS 12
+
+struct ray {
+    glm::vec3 origin { 0, 0, 0 };
+    glm::vec3 dir { 0, 0, -1 };
+};
+
+// Flattened BVH node; two of these fit in a cache line, and siblings are always adjacent.
+// For interior nodes, left_first is the index of the left child (the right child follows it).
+// For leaves, left_first indexes the leaf's primitives, and count is non-zero.
+struct alignas(32) bvh_node {
+    glm::vec3 min {};
+    unsigned int left_first { 0 };
+    glm::vec3 max {};
+    unsigned int count { 0 };
+
+    inline bool is_leaf() const { return count > 0; }
+};
+
+// Ray with the reciprocal direction precomputed for slab tests
+struct bvh_ray {
+    glm::vec3 origin {};
+    glm::vec3 dir {};
+    glm::vec3 inv_dir {};
+
+#ifdef BVH_SIMD
+    __m128 origin4 {};
+    __m128 inv_dir4 {};
+#endif
+
+    bvh_ray(const ray& r) : origin { r.origin }, dir { r.dir }, inv_dir { 1.0f / r.dir.x, 1.0f / r.dir.y, 1.0f / r.dir.z } {
+#ifdef BVH_SIMD
+        origin4 = _mm_setr_ps(origin.x, origin.y, origin.z, 0.0f);
+        inv_dir4 = _mm_setr_ps(inv_dir.x, inv_dir.y, inv_dir.z, 0.0f);
+#endif
+    }
+};
+
+// Slab test; returns the distance at which the ray enters the box, or infinity on a miss
+inline float intersect_node(const bvh_ray& r, const bvh_node& n, float t_max) {
+#ifdef BVH_SIMD
+    // The fourth lane holds left_first/count, but is multiplied by a zero inverse direction
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&n.min.x), r.origin4), r.inv_dir4);
+    __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&n.max.x), r.origin4), r.inv_dir4);
+
+    __m128 v_min = _mm_min_ps(t1, t2);
+    __m128 v_max = _mm_max_ps(t1, t2);
+
+    __m128 near = _mm_max_ss(_mm_max_ss(v_min, _mm_shuffle_ps(v_min, v_min, _MM_SHUFFLE(1, 1, 1, 1))),
+                             _mm_shuffle_ps(v_min, v_min, _MM_SHUFFLE(2, 2, 2, 2)));
+    __m128 far = _mm_min_ss(_mm_min_ss(v_max, _mm_shuffle_ps(v_max, v_max, _MM_SHUFFLE(1, 1, 1, 1))),
+                            _mm_shuffle_ps(v_max, v_max, _MM_SHUFFLE(2, 2, 2, 2)));
+
+    float t_near = _mm_cvtss_f32(near);
+    float t_far = _mm_cvtss_f32(far);
+#else
+    glm::vec3 t1 { (n.min - r.origin) * r.inv_dir };
+    glm::vec3 t2 { (n.max - r.origin) * r.inv_dir };
+
+    glm::vec3 v_min { glm::min(t1, t2) };
+    glm::vec3 v_max { glm::max(t1, t2) };
+
+    float t_near = glm::max(glm::max(v_min.x, v_min.y), v_min.z);
+    float t_far = glm::min(glm::min(v_max.x, v_max.y), v_max.z);
+#endif
+
+    if (t_far >= t_near && t_near < t_max && t_far > 0.0f) return t_near;
+    return std::numeric_limits<float>::infinity();
+}
+
+// Bounding volume hierarchy over arbitrary primitives, described only by their bounds.
+// Built top-down using binned SAH; the node array is flat, rooted at index 0.
+struct bvh {
+    public:
+        void build(const std::vector<aabb>& primitive_bounds, unsigned int max_leaf_size);
+
+        bool empty() const { return m_nodes.empty(); }
+
+        aabb bounds() const;
+
+        // Calls leaf_fn(node, t_max) for every leaf the ray reaches, nearest first where possible.
+        // leaf_fn should reduce t_max when it finds a hit, which prunes the rest of the traversal.
+        template <typename F>
+        void traverse(const bvh_ray& r, float& t_max, F leaf_fn) const {
+            if (m_nodes.empty()) return;
+            if (intersect_node(r, m_nodes[0], t_max) == std::numeric_limits<float>::infinity()) return;
+
+            const bvh_node* stack[BVH_MAX_DEPTH];
+            int stack_size = 0;
+            const bvh_node* n = &m_nodes[0];
+
+            while (true) {
+                if (n->is_leaf()) {
+                    leaf_fn(*n, t_max);
+
+                    if (stack_size == 0) return;
+                    n = stack[--stack_size];
+                    continue;
+                }
+
+                const bvh_node* child_a = &m_nodes[n->left_first];
+                const bvh_node* child_b = &m_nodes[n->left_first + 1];
+
+                float dist_a = intersect_node(r, *child_a, t_max);
+                float dist_b = intersect_node(r, *child_b, t_max);
+
+                if (dist_a > dist_b) {
+                    std::swap(dist_a, dist_b);
+                    std::swap(child_a, child_b);
+                }
+
+                if (dist_a == std::numeric_limits<float>::infinity()) {
+                    if (stack_size == 0) return;
+                    n = stack[--stack_size];
+                    continue;
+                }
+
+                n = child_a;
+                if (dist_b != std::numeric_limits<float>::infinity() && stack_size < BVH_MAX_DEPTH) {
+                    stack[stack_size++] = child_b;
+                }
+            }
+        }
+
+        // Primitive indices, in leaf order
+        std::vector<unsigned int> m_indices {};
+        std::vector<bvh_node> m_nodes {};
+
+    private:
+        void subdivide(unsigned int node_index, const std::vector<aabb>& primitive_bounds,
+                       const std::vector<glm::vec3>& centroids, unsigned int max_leaf_size, int depth);
+};
+
+// Four triangles in structure-of-arrays form, so that one ray can be tested against all of them at once
+struct alignas(16) triangle_packet {
+    float v0_x[4], v0_y[4], v0_z[4];
+    float e1_x[4], e1_y[4], e1_z[4];
+    float e2_x[4], e2_y[4], e2_z[4];
+    unsigned int id[4];
+};
+
+#define TRIANGLE_PACKET_SIZE 4
+
+// BVH over the triangles of a mesh; each leaf holds a single packet of up to four triangles
+struct triangle_bvh {
+    public:
+        // Triangles are given as triples of indices into positions; triangle ids are their position in that list
+        void build(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& triangle_indices);
+
+        // Finds the closest hit nearer than t_max, reducing t_max to it
+        bool intersect(const ray& r, float& t_max, unsigned int& triangle) const;
+
+        bool empty() const { return m_bvh.empty(); }
+
+        aabb bounds() const { return m_bvh.bounds(); }
+
+    private:
+        bvh m_bvh {};
+        std::vector<triangle_packet> m_packets {};
+};
+
+#endif
@@ -21,6 +21,43 @@ struct camera {
     float m_speed { 1 };
 
     float m_shadow_range { 100 };
+
+    // Cascaded shadow maps; the lambda blends logarithmic (1) and uniform (0) split distances,
+    // and cascades after the first are only redrawn every m_shadow_cascade_interval frames
+    int m_shadow_cascades { 3 };
+    float m_shadow_split_lambda { 0.75f };
+    int m_shadow_cascade_interval { 2 };
+
+    // RENDER_PATH_FORWARD or RENDER_PATH_DEFERRED
+    int m_render_path { RENDER_PATH_FORWARD };
+
+    // DEPTH_PREPASS_OFF, DEPTH_PREPASS_ON or DEPTH_PREPASS_AUTO; only used by the forward path
+    int m_depth_prepass { DEPTH_PREPASS_AUTO };
+
+    // The water's reflection is redrawn every m_reflection_interval frames, and reprojected in between. Only
+    // objects within m_reflection_distance, lit by the m_reflection_lights most prominent point lights, are drawn.
+    int m_reflection_interval { 2 };
+    float m_reflection_distance { 60 };
+    int m_reflection_lights { 8 };
+
+    // WATER_REFLECTION_PLANAR, WATER_REFLECTION_SCREEN_SPACE or WATER_REFLECTION_PROBE; only planar reflections
+    // need their own passes
+    int m_water_reflection { WATER_REFLECTION_PLANAR };
+
+    // The view's resolution is scaled down, to no less than m_min_resolution_scale of the window's, when the GPU takes
+    // longer than m_frame_time_target milliseconds a frame; 0 keeps the full resolution. UPSCALE_BILINEAR or
+    // UPSCALE_CATMULL_ROM stretches it back over the window.
+    float m_frame_time_target { 16.6f };
+    float m_min_resolution_scale { 0.5f };
+    int m_upscale_filter { UPSCALE_CATMULL_ROM };
+
+    // Pass timings are shown in the window's title with m_profiler_overlay, and appended to the m_profiler_log file,
+    // one line of JSON a frame, unless it's empty
+    bool m_profiler_overlay { false };
+    std::string m_profiler_log {};
+
+    // 0 is 4-tap bilinear PCF, 1 is 9-tap Gaussian PCF and 2 is rotated Poisson disk PCF
+    int m_shadow_quality { 1 };
     
     float m_near { 0.1f };
     float m_far { 100 };
@@ -49,6 +86,10 @@ struct camera {
 
     glm::mat4 get_perspective_matrix() const;
 
+    // Perspective projection whose near plane is replaced by a view space plane, clipping everything behind it.
+    // The camera has to be behind the plane; otherwise the ordinary projection is returned.
+    glm::mat4 get_oblique_perspective_matrix(const glm::vec4& view_plane) const;
+
     glm::vec3 up() const;
 
     glm::vec3 forward() const;
@@ -148,7 +189,26 @@ namespace serial {
         REPORT(sr, m_speed)
         REPORT(sr, m_mouse)
 
+        REPORT(sr, m_render_path)
+        REPORT(sr, m_depth_prepass)
+
         REPORT(sr, m_shadow_range)
+        REPORT(sr, m_shadow_cascades)
+        REPORT(sr, m_shadow_split_lambda)
+        REPORT(sr, m_shadow_cascade_interval)
+        REPORT(sr, m_shadow_quality)
+
+        REPORT(sr, m_reflection_interval)
+        REPORT(sr, m_reflection_distance)
+        REPORT(sr, m_reflection_lights)
+        REPORT(sr, m_water_reflection)
+
+        REPORT(sr, m_frame_time_target)
+        REPORT(sr, m_min_resolution_scale)
+        REPORT(sr, m_upscale_filter)
+
+        REPORT(sr, m_profiler_overlay)
+        REPORT(sr, m_profiler_log)
     }
 
     template <>
@@ -168,7 +228,26 @@ namespace serial {
         DESERIALISE_VAL(r, n, m_speed)
         DESERIALISE_VAL(r, n, m_mouse)
 
+        DESERIALISE_VAL(r, n, m_render_path)
+        DESERIALISE_VAL(r, n, m_depth_prepass)
+
         DESERIALISE_VAL(r, n, m_shadow_range)
+        DESERIALISE_VAL(r, n, m_shadow_cascades)
+        DESERIALISE_VAL(r, n, m_shadow_split_lambda)
+        DESERIALISE_VAL(r, n, m_shadow_cascade_interval)
+        DESERIALISE_VAL(r, n, m_shadow_quality)
+
+        DESERIALISE_VAL(r, n, m_reflection_interval)
+        DESERIALISE_VAL(r, n, m_reflection_distance)
+        DESERIALISE_VAL(r, n, m_reflection_lights)
+        DESERIALISE_VAL(r, n, m_water_reflection)
+
+        DESERIALISE_VAL(r, n, m_frame_time_target)
+        DESERIALISE_VAL(r, n, m_min_resolution_scale)
+        DESERIALISE_VAL(r, n, m_upscale_filter)
+
+        DESERIALISE_VAL(r, n, m_profiler_overlay)
+        DESERIALISE_VAL(r, n, m_profiler_log)
 
         return r;
     }
@@ -0,0 +1,86 @@
+#ifndef CLUSTERS_H
+#define CLUSTERS_H
+
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#   define CLUSTERS_SIMD 1
+#   include <xmmintrin.h>
+#endif
+
+#include "bounds.h"
+
+struct point_light;
+
+// View-space froxel grid; tiles evenly divide the screen, and slices are spaced exponentially in depth.
+// These must match the constants in phong.fs.
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+
+#define MAX_CLUSTERED_LIGHTS 1024
+
+// The light index list is stored in a texture this wide, and at most this long
+#define CLUSTER_INDEX_TEXTURE_WIDTH 1024
+#define MAX_CLUSTER_INDICES (CLUSTER_INDEX_TEXTURE_WIDTH * 256)
+
+// Texels per light in the light data texture
+#define CLUSTER_LIGHT_TEXELS 4
+
+// Point lights are assigned to every cluster that their sphere of influence touches. Everything that
+// phong.fs needs is uploaded into textures:
+//  - light data, CLUSTER_LIGHT_TEXELS RGBA32F texels per light, one light per column
+//  - the offset and count of each cluster's lights in the index list, one RG32UI texel per cluster
+//  - the index list itself, as R16UI
+struct light_clusters {
+    public:
+        void initialise();
+
+        void destroy();
+
+        // Bin the lights for a camera with this view and (symmetric) perspective projection
+        void build(const std::vector<point_light*>& lights, const glm::mat4& view, const glm::mat4& proj, float near, float far);
+
+        void bind(GLenum lights_unit, GLenum clusters_unit, GLenum indices_unit) const;
+
+        // x is the near plane distance, y is log(far / near); slices are found from these in phong.fs
+        glm::vec2 depth_params() const { return { m_near, glm::log(m_far / m_near) }; }
+
+        int num_lights() const { return m_num_lights; }
+
+    private:
+        void build_cluster_bounds(const glm::mat4& proj, float near, float far);
+
+        void bin_slice(int slice);
+
+        float m_near { 0.1f };
+        float m_far { 100.0f };
+        int m_num_lights { 0 };
+
+        // Cluster bounds only depend on the projection, so are only rebuilt when it changes
+        glm::mat4 m_bounds_proj { 0.0f };
+        std::vector<aabb> m_cluster_bounds {};
+
+        // View-space light spheres; each slice gathers the ones it needs into its own SIMD-friendly arrays
+        std::vector<float> m_light_x {};
+        std::vector<float> m_light_y {};
+        std::vector<float> m_light_z {};
+        std::vector<float> m_light_radius {};
+
+        // Each slice is binned independently, then the results are joined
+        std::vector<std::vector<GLushort>> m_slice_indices {};
+        std::vector<GLuint> m_cluster_ranges {};
+        std::vector<GLushort> m_indices {};
+        std::vector<glm::vec4> m_light_data {};
+
+        GLuint m_lights_texture { 0 };
+        GLuint m_clusters_texture { 0 };
+        GLuint m_indices_texture { 0 };
+};
+
+#endif
@@ -7,17 +7,61 @@
 
 #include "light.h"
 #include "serialise.h"
+#include "bounds.h"
+
+// Must match MAX_SHADOW_CASCADES in phong.fs
+#define MAX_SHADOW_CASCADES 4
+
+// Shadow filtering kernels, selected by camera::m_shadow_quality; compiled in as PCF_KERNEL by lighting.glsl
+#define SHADOW_QUALITY_BILINEAR 0
+#define SHADOW_QUALITY_GAUSSIAN 1
+#define SHADOW_QUALITY_POISSON 2
+
+// Fraction of each cascade, at its far end, over which it fades into the next one
+#define SHADOW_CASCADE_BLEND_BAND 0.1f
+
+// Casters whose light-space footprint covers fewer shadow map texels than this are not drawn
+#define SHADOW_CASTER_MIN_TEXELS 1.0f
 
 struct application;
 struct camera;
 
+// Light-space box that a shadow map has to cover, around one slice of the camera frustum. The light looks down -z, so +z points back toward the light.
+struct shadow_volume {
+    glm::mat4 light_view { 1.0f };
+    aabb bounds {};
+
+    // Can a caster with these light-space bounds throw a shadow into the volume? Anything between
+    // the volume and the light counts, so only the sides and the far end of the box are tested.
+    bool reaches(const aabb& caster) const;
+
+    // Is the caster's footprint big enough to show up in a shadow map of this resolution?
+    bool resolvable(const aabb& caster, int resolution) const;
+
+    // Pull the near plane toward the light, so that a caster's full depth range is inside the projection
+    void extend_toward_light(const aabb& caster);
+
+    glm::mat4 get_matrix() const;
+};
+
 struct directional_light {
     glm::vec3 direction { 0, 0, -1 };
     light base;
     bool shadow_caster { false };
     float frequency { 0 };
 
-    glm::mat4 get_shadow_matrix(camera* camera, glm::mat4& camera_view);
+    // Turning the light through this is counted, so that cached shadow maps can tell that they're out of date
+    void set_direction(glm::vec3 d) {
+        if (d == direction) return;
+        direction = d;
+        revision += 1;
+    }
+
+    unsigned int revision { 0 };
+
+    // Light-space volume covering the slice of the camera's view between near_z and far_z, for a shadow map
+    // of the given resolution
+    shadow_volume get_shadow_volume(camera* camera, glm::mat4& camera_view, float near_z, float far_z, int resolution);
 };
 
 REGISTER_PARSE_REF(directional_light);
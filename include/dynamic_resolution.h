@@ -0,0 +1,44 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+// The scale moves in steps of this much, so that the targets sized by it aren't recreated every frame
+#define RESOLUTION_SCALE_STEP 0.05f
+
+// The scale is only raised while frames come in under this fraction of the target, so that it doesn't hunt, and then
+// only this much of the way at a time; it's lowered straight away
+#define RESOLUTION_RAISE_HEADROOM 0.85f
+#define RESOLUTION_RAISE_RATE 0.05f
+
+// Frames measured after the scale changes are ignored for this long, as they were drawn at the old scale
+#define RESOLUTION_SETTLE_FRAMES 4
+
+// Picks the fraction of the window's size the camera's view is drawn at, from how long the GPU took over recent frames,
+// as measured by the profiler. Where the GPU can't be timed, as in WebGL, the scale stays at 1.
+struct resolution_controller {
+    public:
+        resolution_controller() {}
+
+        resolution_controller(const resolution_controller&) = delete;
+        resolution_controller& operator=(const resolution_controller&) = delete;
+
+        // Takes the GPU time of the last frame measured, and moves the scale toward the one that would bring frames in
+        // at target_ms, no lower than min_scale. A target of 0 keeps the full resolution.
+        void update(float frame_ms, unsigned int measured_frame, float target_ms, float min_scale);
+
+        float scale() const { return m_scale; }
+
+        // Smoothed GPU time per frame, in milliseconds
+        float frame_ms() const { return m_frame_ms; }
+
+    private:
+        unsigned int m_measured_frame { 0 };
+        int m_settle { 0 };
+
+        float m_frame_ms { 0.0f };
+
+        // The scale the measurements ask for, and the step it's rounded down to
+        float m_ideal_scale { 1.0f };
+        float m_scale { 1.0f };
+};
+
+#endif
@@ -1,13 +1,13 @@
 #ifndef DIRECTIONAL_SHADOW_MAP_H
 #define DIRECTIONAL_SHADOW_MAP_H
 
-#include <glad/glad.h>
+#include <vector>
 
-#define DEFAULT_SHADOW_MAP_WIDTH 1920 * 2
-#define DEFAULT_SHADOW_MAP_HEIGHT 1920 * 2
+#include <glad/glad.h>
 
-#define DEFAULT_REFRACTION_MAP_WIDTH 1280
-#define DEFAULT_REFRACTION_MAP_HEIGHT 720
+// Size of each shadow cascade
+#define DEFAULT_SHADOW_MAP_WIDTH 1536
+#define DEFAULT_SHADOW_MAP_HEIGHT 1536
 
 #define DEFAULT_REFLECTION_MAP_WIDTH 320
 #define DEFAULT_REFLECTION_MAP_HEIGHT 180
@@ -22,12 +22,50 @@ struct fbo {
 
     bool m_depth_attachment { false };
     bool m_color_attachment { false };
+
+    // Layered FBOs keep their depth in a texture array, and render into one layer at a time
+    GLenum m_depth_target { GL_TEXTURE_2D };
+    int m_layers { 1 };
     
-    void initialise(int pixel_width, int pixel_height, bool depth, bool color, bool set_boundaries);
+    // Camera views use GL_DEPTH_COMPONENT32F, for reversed-Z; shadow maps keep 24 bit depth
+    void initialise(int pixel_width, int pixel_height, bool depth, bool color, bool set_boundaries,
+                    GLenum depth_format = GL_DEPTH_COMPONENT24);
+
+    void initialise_layered(int pixel_width, int pixel_height, int layers);
+
+    // Multiple render targets, one colour texture per format, plus a depth texture
+    std::vector<GLuint> m_color_targets {};
+
+    void initialise_targets(int pixel_width, int pixel_height, const std::vector<GLenum>& formats,
+                            GLenum depth_format = GL_DEPTH_COMPONENT24);
+
+    // Depth-only mip chain, with 32 bit float depth; each level is drawn from the one before it
+    int m_levels { 1 };
+
+    void initialise_pyramid(int pixel_width, int pixel_height, int levels);
+
+    void destroy();
     
     void bind_for_writing();
+    void bind_layer_for_writing(int layer);
+    void bind_level_for_writing(int level);
+
+    void bind_target_for_reading(int target, GLenum texture_unit);
+
+    // Copy one depth layer into the same layer of another layered FBO, which is left bound for writing
+    void blit_layer_depth(fbo& destination, int layer);
+
+    // Copy colour and/or depth into another FBO of the same size and formats, which is left bound for writing
+    void blit(fbo& destination, GLbitfield buffers);
+
+    // Copy the first colour target to the window's framebuffer, which is left bound
+    void blit_to_screen(int screen_width, int screen_height);
+
     void bind_depth_for_reading(GLenum texture_unit);
     void bind_color_for_reading(GLenum texture_unit);
+
+    // Restricts sampling to a range of mip levels, so that another level can be drawn into at the same time
+    void bind_levels_for_reading(int base_level, int max_level, GLenum texture_unit);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,37 @@
+#ifndef KTX_H
+#define KTX_H
+
+#include <cstdint>
+
+// Cooked textures are KTX 1.1 files, written by texture_cooker and read by texture::load. The header is followed by
+// each mip level in turn, largest first, as its size in bytes and then its blocks.
+
+// Block compressed formats the cooker produces; the values are the GL internal formats
+#define KTX_COMPRESSED_RGB_BC1  0x83F0
+#define KTX_COMPRESSED_RGBA_BC3 0x83F3
+#define KTX_COMPRESSED_RED_BC4  0x8DBB
+
+#define KTX_ENDIANNESS 0x04030201
+
+// Cooked files sit next to their source image, with this appended to its name
+#define KTX_EXTENSION ".ktx"
+
+static const unsigned char ktx_identifier[12] { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct ktx_header {
+    std::uint32_t endianness;
+    std::uint32_t gl_type;
+    std::uint32_t gl_type_size;
+    std::uint32_t gl_format;
+    std::uint32_t gl_internal_format;
+    std::uint32_t gl_base_internal_format;
+    std::uint32_t pixel_width;
+    std::uint32_t pixel_height;
+    std::uint32_t pixel_depth;
+    std::uint32_t number_of_array_elements;
+    std::uint32_t number_of_faces;
+    std::uint32_t number_of_mipmap_levels;
+    std::uint32_t bytes_of_key_value_data;
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/vec4.hpp>
+
+#include "material.h"
+
+#define MAX_MATERIALS 1024
+
+// Texels per material in the table; these must match the fetches in phong.vs
+#define MATERIAL_TABLE_TEXELS 4
+
+// Every loaded material, in an RGBA32F texture with one material per column, so that shaders can look materials up by
+// the id stored in each vertex rather than have them set per draw:
+//  - ambient colour, and the diffuse texture's array layer, or -1 without one
+//  - diffuse colour, and the specular texture's array layer
+//  - specular colour
+//  - the finest mip level that has arrived of the diffuse and then the specular texture
+struct material_table {
+    public:
+        material_table() {}
+
+        material_table(const material_table&) = delete;
+        material_table& operator=(const material_table&) = delete;
+
+        // Returns the material's id; its textures are followed as they stream in
+        unsigned int add(const material& m);
+
+        // Uploads whatever has changed since the last frame
+        void update();
+
+        void bind(GLenum texture_unit) const;
+
+    private:
+        std::vector<material> m_materials {};
+        std::vector<glm::vec4> m_data {};
+
+        GLuint m_texture { 0 };
+};
+
+// Shared table used by every mesh
+material_table& shared_materials();
+
+#endif
@@ -15,18 +15,30 @@
 #include <assimp/postprocess.h>
 
 #include "material.h"
+#include "bounds.h"
+#include "bvh.h"
 
 #define INVALID_MATERIAL 0xFFFFFFFF
 
+struct pipeline;
+
 struct mesh {
     public:
         mesh() {};
 
         void load(const std::string& file_name);
 
-        void render();
+        // Neighbouring submeshes are drawn together when their textures share arrays; given a pipeline, each draw picks
+        // the shader variant its materials need
+        void render(pipeline* p = nullptr);
+
+        const std::vector<material>& materials() const { return m_materials; }
+
+        // Closest hit in model space nearer than t_max; on a hit, t_max is reduced to it and the
+        // submesh and triangle (relative to that submesh) are reported
+        bool raycast(const ray& r, float& t_max, unsigned int& submesh, unsigned int& triangle) const;
 
-        material& get_material();
+        const aabb& bounds() const { return m_bounds; }
 
     private:
 
@@ -42,9 +54,10 @@ struct mesh {
             V_POS_BUFFER = 1,
             V_TEX_BUFFER = 2,
             V_NORM_BUFFER = 3,
-            MVP_MAT_BUFFER = 4,  // required only for instancing
-            MODEL_MAT_BUFFER = 5,  // required only for instancing
-            NUM_BUFFERS = 6
+            V_MATERIAL_BUFFER = 4,
+            MVP_MAT_BUFFER = 5,  // required only for instancing
+            MODEL_MAT_BUFFER = 6,  // required only for instancing
+            NUM_BUFFERS = 7
         };
 
         void init_from_scene(const aiScene* p_scene, const std::string& file_name);
@@ -60,6 +73,8 @@ struct mesh {
         void init_materials(const aiScene* p_scene, const std::string& file_name);
         
         void populate_buffers();
+
+        void build_bvh();
         
 
         std::vector<mesh_entry> m_meshes {};
@@ -69,9 +84,16 @@ struct mesh {
 
         std::vector<material> m_materials {};
 
+        // Each material's id in the shared material table
+        std::vector<unsigned int> m_material_ids {};
+
         std::vector<glm::vec3> m_vert_positions {};
         std::vector<glm::vec2> m_vert_texcoords {};
         std::vector<glm::vec3> m_vert_normals {};
+        std::vector<GLuint> m_vert_materials {};
+
+        aabb m_bounds {};
+        triangle_bvh m_bvh {};
 };
 
 
@@ -8,6 +8,7 @@ struct camera;
 struct directional_light;
 struct light;
 struct point_light;
+struct reflection_probe;
 struct renderer;
 struct script;
 struct transform;
@@ -18,6 +19,7 @@ namespace serial {
     void serialise(std::ostream& os, const directional_light& obj, const scene_node* sc, int indt);
     void serialise(std::ostream& os, const light& obj, const scene_node* sc, int indt);
     void serialise(std::ostream& os, const point_light& obj, const scene_node* sc, int indt);
+    void serialise(std::ostream& os, const reflection_probe& obj, const scene_node* sc, int indt);
     void serialise(std::ostream& os, const renderer& obj, const scene_node* sc, int indt);
     void serialise(std::ostream& os, const script& obj, const scene_node* sc, int indt);
     void serialise(std::ostream& os, const transform& obj, const scene_node* sc, int indt);
@@ -9,6 +9,7 @@ enum class scene_node_type {
     directional_light,
     light,
     point_light,
+    reflection_probe,
     renderer,
     script,
     transform,
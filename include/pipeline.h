@@ -3,17 +3,39 @@
 
 #include <string>
 #include <vector>
+#include <unordered_map>
 
 #include <glad/glad.h>
 #include <glm/mat4x4.hpp>
 
 #include "point_light.h"
 #include "directional_light.h"
-#include "material.h"
+
+struct reflection_probe;
 
 #define UNDEFINED_PIPELINE -1
 #define STANDARD_PIPELINE 0
 #define WATER_PIPELINE 1
+#define DEFERRED_PIPELINE 2
+
+// Linked programs are saved here, named by a hash of their sources and the driver, so that later runs can skip compiling
+#define SHADER_CACHE_DIRECTORY "shader_cache/"
+
+// Shader features. Each pipeline is compiled once for every combination of the features it supports that it's
+// used with; a #define for every feature in the combination is injected after the #version line, so that
+// branches and samplers the variant doesn't need are compiled out
+#define PIPELINE_FEATURE_SHADOWS        (1u << 0)
+#define PIPELINE_FEATURE_POINT_LIGHTS   (1u << 1)
+#define PIPELINE_FEATURE_SPECULAR_MAP   (1u << 2)
+#define PIPELINE_FEATURE_REFLECTION     (1u << 3)
+
+// Two bits select the shadow filtering kernel, one of the SHADOW_QUALITY_* values, as PCF_KERNEL
+#define PIPELINE_FEATURE_PCF_SHIFT      4
+#define PIPELINE_FEATURE_PCF_MASK       (3u << PIPELINE_FEATURE_PCF_SHIFT)
+#define PIPELINE_FEATURE_PCF(kernel)    (static_cast<unsigned int>(kernel) << PIPELINE_FEATURE_PCF_SHIFT)
+
+#define PIPELINE_LIGHTING_FEATURES (PIPELINE_FEATURE_SHADOWS | PIPELINE_FEATURE_POINT_LIGHTS \
+                                    | PIPELINE_FEATURE_SPECULAR_MAP | PIPELINE_FEATURE_PCF_MASK)
 
 struct pipeline {
     public:
@@ -21,27 +43,47 @@ struct pipeline {
             UNIFORM_MODEL_MAT,
             UNIFORM_VIEW_MAT,
             UNIFORM_PROJ_MAT,
+            UNIFORM_INV_VIEW_MAT,
             UNIFORM_SHADOW0_MAT,
+            UNIFORM_SHADOW_MATS,
+            UNIFORM_CASCADE_SPLITS,
+            UNIFORM_NUM_CASCADES,
+            UNIFORM_SHADOW_TEXEL_SIZE,
             UNIFORM_SAMPLER_DIFFUSE,
             UNIFORM_SAMPLER_SPECULAR,
             UNIFORM_SAMPLER_DEPTH0,
+            UNIFORM_SAMPLER_SHADOW,
             UNIFORM_SAMPLER_NOISE,
             UNIFORM_SAMPLER_DUDV,
             UNIFORM_SAMPLER_REFLECTION,
             UNIFORM_SAMPLER_REFRACTION,
             UNIFORM_SAMPLER_NORMAL,
+            UNIFORM_SAMPLER_GBUFFER_AMBIENT,
+            UNIFORM_SAMPLER_GBUFFER_DIFFUSE,
+            UNIFORM_SAMPLER_GBUFFER_SPECULAR,
+            UNIFORM_SAMPLER_GBUFFER_NORMAL,
+            UNIFORM_SAMPLER_LIGHTS,
+            UNIFORM_SAMPLER_CLUSTERS,
+            UNIFORM_SAMPLER_LIGHT_INDICES,
+            UNIFORM_SAMPLER_DEPTH_PYRAMID,
+            UNIFORM_SAMPLER_PROBE0,
+            UNIFORM_SAMPLER_PROBE1,
+            UNIFORM_SAMPLER_MATERIALS,
+            UNIFORM_SAMPLER_COLOR,
+            UNIFORM_DEPTH_PYRAMID_LEVELS,
+            UNIFORM_CLUSTER_DEPTH,
             UNIFORM_DIR_LIGHTS,
-            UNIFORM_POINT_LIGHTS,
-            UNIFORM_MATERIAL,
-            UNIFORM_MATERIAL__AMBIENT_COLOR,
-            UNIFORM_MATERIAL__DIFFUSE_COLOR,
-            UNIFORM_MATERIAL__SPECULAR_COLOR,
+            UNIFORM_REFLECTION_PROBES,
             UNIFORM_TIME,
             UNIFORM_CAMERA_POS,
             UNIFORM_CAMERA_FAR,
             UNIFORM_CAMERA_NEAR,
-            UNIFORM_CLIP_PLANE,
-            UNIFORM_CLIP_ENABLED
+            UNIFORM_REFRACTION_DEPTH,
+            UNIFORM_REFLECTION_MAT,
+            UNIFORM_REFLECTION_MODE,
+            UNIFORM_REFLECTION_DISTANCE,
+            UNIFORM_SKY_COLOR,
+            UNIFORM_COUNT
         };
 
         struct shader_src {
@@ -49,30 +91,87 @@ struct pipeline {
             std::string file_name;
         };
         
-        void initialise(std::vector<shader_src> shaders, int identifier);
+        // Features outside of supported_features are ignored when choosing a variant
+        void initialise(std::vector<shader_src> shaders, int identifier, unsigned int supported_features = 0);
+
+        // Start building the variant for these features without waiting for it; it's only checked when first used
+        void prepare(unsigned int features);
 
-        void enable();
+        // Use the variant for these features; uniforms are set on that variant until the next enable
+        void enable(unsigned int features = 0);
+
+        // Per draw features come from the materials drawn. Switching variant mid-pass carries every uniform set so far over.
+        void select_material(bool specular_map);
 
         void set_uniform(uniform u, glm::mat4& matrix);
+        void set_uniform(uniform u, std::vector<glm::mat4>& matrices);
+        void set_uniform(uniform u, std::vector<float>& inputs);
         void set_uniform(uniform u, int input);
         void set_uniform(uniform u, float input);
         void set_uniform(uniform u, std::vector<directional_light*> lights);
-        void set_uniform(uniform u, std::vector<point_light*> lights);
-        void set_uniform(uniform u, material& material);
+        void set_uniform(uniform u, std::vector<reflection_probe*> probes);
+        void set_uniform(uniform u, glm::vec2 vector);
         void set_uniform(uniform u, glm::vec3 vector);
         void set_uniform(uniform u, glm::vec4 vector);
 
         int identifier() { return m_identifier; }
 
     private:
-        void add_shader(GLuint type, std::string file_name);
+        // One compiled program per feature combination, with its uniform locations looked up as they're first used
+        struct variant {
+            GLuint program { 0 };
+
+            // Until the first use, the program may still be compiling; shaders is empty if it came from the cache
+            bool pending { false };
+            std::vector<GLuint> shaders {};
+            std::string cache_file {};
+
+            std::vector<GLint> locations {};
+            std::unordered_map<std::string, GLint> named_locations {};
+        };
+
+        // The last value given to each uniform, kept so that it can be set again on another variant
+        struct uniform_value {
+            enum { NONE, MATRIX, MATRICES, FLOATS, INT, FLOAT, VEC2, VEC3, VEC4, DIR_LIGHTS, PROBES } kind { NONE };
 
-        void finalise();
+            glm::mat4 matrix { 1.0f };
+            glm::vec4 vector { 0.0f };
+            int i { 0 };
+            float f { 0.0f };
+
+            std::vector<glm::mat4> matrices {};
+            std::vector<float> floats {};
+            std::vector<directional_light*> lights {};
+            std::vector<reflection_probe*> probes {};
+        };
+
+        void use_variant(unsigned int features);
+
+        void finish_variant(variant& v);
+
+        GLuint add_shader(GLuint program, GLuint type, const std::string& source);
+
+        void check_shader(GLuint shader, GLuint type, const std::string& file_name);
+
+        bool load_binary(variant& v);
+        void save_binary(variant& v);
+
+        void replay_uniforms();
 
         GLint get_uniform_location(uniform u);
+        GLint get_uniform_location(const char* name);
+
+        std::vector<shader_src> m_shaders {};
+        std::vector<std::string> m_sources {};
 
+        unsigned int m_supported_features { 0 };
+        unsigned int m_features { 0 };
+
+        std::unordered_map<unsigned int, variant> m_variants {};
+        variant* m_variant { nullptr };
         GLuint m_program {};
-        std::vector<GLuint> m_temp_shader_handles {};
+
+        std::vector<uniform_value> m_values {};
 
         int m_identifier { UNDEFINED_PIPELINE };
 };
@@ -1,18 +1,45 @@
 #ifndef POINT_LIGHT_H
 #define POINT_LIGHT_H
 
+#include <cmath>
+#include <limits>
 #include <glm/vec3.hpp>
+#include <glm/common.hpp>
 
 #include "transform.h"
 #include "light.h"
 #include "serialise.h"
 
+// Lights are treated as having no effect once they fall below this fraction of their brightness
+#define POINT_LIGHT_CUTOFF (1.0f / 256.0f)
+
 struct point_light {
     transform transform;
     light base;
     float attn_const { 1.0f };
     float attn_linear { 1.0f };
     float attn_exp { 0.0f };
+
+    // Distance beyond which the light's contribution falls below POINT_LIGHT_CUTOFF of its full brightness
+    float radius() const {
+        float brightness = glm::max(glm::max(base.color.r, base.color.g), base.color.b)
+                         * (base.ambient_intensity + base.diffuse_intensity + base.specular_intensity);
+
+        // Solve attn_const + attn_linear * d + attn_exp * d^2 = brightness / cutoff
+        float target = brightness / POINT_LIGHT_CUTOFF;
+
+        if (target <= attn_const) return 0.0f;
+
+        if (attn_exp > 0.0f) {
+            float discriminant = attn_linear * attn_linear - 4.0f * attn_exp * (attn_const - target);
+            return (-attn_linear + std::sqrt(discriminant)) / (2.0f * attn_exp);
+        }
+
+        if (attn_linear > 0.0f) return (target - attn_const) / attn_linear;
+
+        // Constant attenuation only, so the light reaches everywhere
+        return std::numeric_limits<float>::infinity();
+    }
 };
 
 REGISTER_PARSE_REF(point_light);
@@ -0,0 +1,101 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <unordered_map>
+
+#include <glad/glad.h>
+
+// Frames of timestamp queries in flight; a frame's results are read back once the GPU has finished it, and if it's
+// still going when its slot comes round again, that frame is given up on rather than waited for
+#define PROFILER_FRAMES 4
+
+// Weight of each new frame in the smoothed timings
+#define PROFILER_SMOOTHING 0.1f
+
+// Times the passes of each frame, on the GPU with GL_TIMESTAMP queries between them, and on the CPU around their
+// submission. GPU times are missing where timestamps aren't supported, as in WebGL; CPU times always come through,
+// so that a software rasteriser still reports something.
+struct gpu_profiler {
+    public:
+        struct timing {
+            std::string name {};
+            float gpu_ms { 0.0f };
+            float cpu_ms { 0.0f };
+        };
+
+        gpu_profiler() {}
+
+        gpu_profiler(const gpu_profiler&) = delete;
+        gpu_profiler& operator=(const gpu_profiler&) = delete;
+
+        void initialise();
+
+        // Collects whichever earlier frames have finished, without waiting for the rest
+        void begin_frame(unsigned int frame);
+        void end_frame();
+
+        // Passes can't be nested
+        void begin_pass(const std::string& name);
+        void end_pass();
+
+        bool gpu_timing() const { return m_gpu_timing; }
+
+        // Smoothed, for the passes of the last frame collected, in the order they ran
+        const std::vector<timing>& timings() const { return m_timings; }
+        const timing& frame_timing() const { return m_frame; }
+
+        // Unsmoothed GPU time of the last frame collected, and which frame that was
+        float last_frame_gpu_ms() const { return m_last_frame_gpu_ms; }
+        unsigned int last_frame() const { return m_last_frame; }
+
+        // Each frame's own timings are appended to this file as a line of JSON; an empty path stops logging
+        void set_log(const std::string& path);
+
+    private:
+        using clock = std::chrono::steady_clock;
+
+        struct frame_slot {
+            unsigned int frame { 0 };
+            bool pending { false };
+
+            // A timestamp at the start of the frame, then one at the end of each pass; empty without GPU timing
+            std::vector<GLuint> queries {};
+            int queries_used { 0 };
+
+            std::vector<timing> passes {};
+            float cpu_ms { 0.0f };
+        };
+
+        // Returns false if the GPU hasn't got through the slot's frame yet
+        bool collect(frame_slot& slot);
+
+        void timestamp(frame_slot& slot);
+
+        void write_log(const frame_slot& slot, float gpu_ms);
+
+        frame_slot m_slots[PROFILER_FRAMES] {};
+        int m_slot { 0 };
+        bool m_in_frame { false };
+
+        bool m_gpu_timing { false };
+
+        clock::time_point m_frame_start {};
+        clock::time_point m_pass_start {};
+
+        std::unordered_map<std::string, timing> m_smoothed {};
+        std::vector<timing> m_timings {};
+        timing m_frame { "frame" };
+        bool m_measured { false };
+
+        float m_last_frame_gpu_ms { 0.0f };
+        unsigned int m_last_frame { 0 };
+
+        std::string m_log_path {};
+        std::ofstream m_log {};
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef REFLECTION_PROBE_H
+#define REFLECTION_PROBE_H
+
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/vec3.hpp>
+
+#include "serialise.h"
+
+// Must match MAX_BLENDED_PROBES in water.fs
+#define MAX_BLENDED_PROBES 2
+
+#define DEFAULT_PROBE_RESOLUTION 128
+
+// Cubemap of the scene as seen from a point, captured once and then only looked up. Lookups are parallax
+// corrected against a box around the probe, given relative to its position, and probes fade out over their radius.
+// If cache names a file, the capture is read from there when the scene loads, and written there once taken.
+struct reflection_probe {
+    glm::vec3 position { 0, 0, 0 };
+    glm::vec3 box_min { -10, -10, -10 };
+    glm::vec3 box_max { 10, 10, 10 };
+    float radius { 30 };
+    int resolution { DEFAULT_PROBE_RESOLUTION };
+    std::string cache {};
+
+    GLuint cubemap { 0 };
+    bool captured { false };
+
+    // Capture again on the next frame, ignoring the cache
+    void recapture() { captured = false; m_ignore_cache = true; }
+
+    // Creates the cubemap, with storage for every face
+    void allocate();
+
+    void destroy();
+
+    void bind(GLenum texture_unit) const;
+
+    // Faces are tightly packed RGBA8, in GL_TEXTURE_CUBE_MAP_POSITIVE_X order
+    bool read_cache(std::vector<unsigned char>& faces) const;
+    void write_cache(const std::vector<unsigned char>& faces) const;
+
+    // Fills every face of the cubemap from the cache; false if there's no usable cache
+    bool load_cache();
+
+    bool ignore_cache() const { return m_ignore_cache; }
+
+    // The cubemap now holds a fresh capture
+    void set_captured() { captured = true; m_ignore_cache = false; }
+
+    private:
+        bool m_ignore_cache { false };
+};
+
+struct application;
+struct scene;
+
+template<>
+inline void load<reflection_probe>(application* app, scene* scene, scene_node* this_node, reflection_probe* probe) {
+    probe->load_cache();
+}
+
+REGISTER_PARSE_REF(reflection_probe)
+
+namespace serial {
+    inline void serialise(std::ostream& os, const reflection_probe& obj, const scene_node* sc, int indt) {
+        serial::serialiser<reflection_probe> sr = { os, obj, sc, indt };
+
+        REPORT(sr, position)
+        REPORT(sr, box_min)
+        REPORT(sr, box_max)
+        REPORT(sr, radius)
+        REPORT(sr, resolution)
+        REPORT(sr, cache)
+    }
+
+    template <>
+    inline option<reflection_probe*, error> deserialise_ref<reflection_probe>(arena& arena, scene_node* root, node* n) {
+        reflection_probe* r = arena.allocate<reflection_probe>();
+
+        DESERIALISE_VAL(r, n, position)
+        DESERIALISE_VAL(r, n, box_min)
+        DESERIALISE_VAL(r, n, box_max)
+        DESERIALISE_VAL(r, n, radius)
+        DESERIALISE_VAL(r, n, resolution)
+        DESERIALISE_VAL(r, n, cache)
+
+        return r;
+    }
+}
+
+#endif
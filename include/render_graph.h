@@ -0,0 +1,133 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <vector>
+#include <string>
+#include <functional>
+
+#include <glad/glad.h>
+
+#include "fbo.h"
+#include "profiler.h"
+
+// Pooled framebuffers that no target has used for this many frames are freed
+#define RENDER_GRAPH_IDLE_FRAMES 60
+
+// Points in the frame where passes registered by other systems are declared: once the shadow maps are drawn, before
+// the opaque scene is lit; once the opaque scene is in the main view and copied for refraction, before the water; and
+// once everything is in the main view, before it's presented
+#define RENDER_STAGE_BEFORE_LIGHTING 0
+#define RENDER_STAGE_BEFORE_WATER 1
+#define RENDER_STAGE_BEFORE_PRESENT 2
+
+// What a transient target is made of. Screen sized targets are the window's size divided by divisor, and are
+// recreated when it changes; targets with a divisor of 0 keep width and height.
+struct render_target_desc {
+    std::vector<GLenum> formats {};
+    GLenum depth_format { GL_DEPTH_COMPONENT32F };
+
+    int divisor { 1 };
+    int width { 0 };
+    int height { 0 };
+
+    // More than one level makes a depth-only pyramid, and formats are ignored
+    int levels { 1 };
+
+    bool operator==(const render_target_desc& other) const {
+        return formats == other.formats && depth_format == other.depth_format && divisor == other.divisor &&
+               width == other.width && height == other.height && levels == other.levels;
+    }
+};
+
+// A frame, declared as passes that read and write targets. Transient targets only exist for the frame, and are
+// taken from a pool of framebuffers: targets of the same kind whose lifetimes don't overlap share one, and
+// framebuffers no target has needed for a while are freed. Persistent resources, like the shadow maps, are owned elsewhere
+// and only imported so that their passes can be ordered and culled.
+//
+// Passes run in the order they were added, which must already be one where every target is written before it's read.
+// Passes that nothing reads from are culled, unless they have side effects, like drawing to the window.
+//
+// Systems add passes of their own by registering a function for one of the RENDER_STAGEs; it's called every frame
+// when the frame reaches that stage, and finds the frame's targets by name.
+struct render_graph {
+    public:
+        using resource = int;
+        using pass_declarer = std::function<void(render_graph&)>;
+
+        render_graph() {}
+
+        render_graph(const render_graph&) = delete;
+        render_graph& operator=(const render_graph&) = delete;
+
+        // Forgets the last frame's passes and targets; pooled framebuffers and registered declarers are kept for this one
+        void clear();
+
+        // Declarers for a stage are called in the order they were registered
+        void register_passes(int stage, pass_declarer declare);
+
+        // Called by whoever builds the frame, at the point the stage stands for
+        void declare_stage(int stage);
+
+        // A target or imported resource declared this frame, or -1 if there's none by that name
+        resource find(const std::string& name) const;
+
+        resource create_target(const std::string& name, const render_target_desc& desc);
+        resource import_resource(const std::string& name);
+
+        void add_pass(const std::string& name, const std::vector<resource>& reads, const std::vector<resource>& writes,
+                      std::function<void()> execute, bool side_effects = false);
+
+        // Culls, allocates and runs the passes, each timed by the profiler if there is one
+        void execute(int screen_width, int screen_height, gpu_profiler* profiler = nullptr);
+
+        // A transient target's framebuffer; only valid inside the passes that read or write it
+        fbo& target(resource r);
+
+        void destroy();
+
+    private:
+        struct pass {
+            std::string name {};
+            std::vector<resource> reads {};
+            std::vector<resource> writes {};
+            std::function<void()> execute {};
+            bool side_effects { false };
+            bool culled { false };
+        };
+
+        struct graph_resource {
+            std::string name {};
+            render_target_desc desc {};
+            bool imported { false };
+
+            // First and last passes to use it, and where it lives in the pool
+            int first_pass { -1 };
+            int last_pass { -1 };
+            int pooled { -1 };
+        };
+
+        struct pooled_target {
+            render_target_desc desc {};
+            int width { 0 };
+            int height { 0 };
+            fbo target {};
+
+            // Last pass this frame that uses it, or -1 while it's unused
+            int busy_until { -1 };
+
+            // Frames since it was last used; -1 once it's been freed
+            int idle_frames { 0 };
+        };
+
+        void cull();
+
+        void allocate(int screen_width, int screen_height);
+
+        std::vector<std::pair<int, pass_declarer>> m_declarers {};
+
+        std::vector<pass> m_passes {};
+        std::vector<graph_resource> m_resources {};
+        std::vector<pooled_target> m_pool {};
+};
+
+#endif
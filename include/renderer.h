@@ -10,6 +10,7 @@
 #include "serialise.h"
 #include "parse_declarations.h"
 #include "pipeline.h"
+#include "bounds.h"
 
 struct renderer {
     transform m_transform {};
@@ -17,6 +18,10 @@ struct renderer {
     std::string filename {};
 
     int m_pipeline { STANDARD_PIPELINE };
+
+    aabb world_bounds() const {
+        return m_mesh.bounds().transformed(m_transform.get_model_matrix());
+    }
 };
 
 struct application;
@@ -37,11 +42,8 @@ inline void render<renderer>(application* app, scene* scene, scene_node* this_no
     glm::mat4 model_mat { r->m_transform.get_model_matrix() };
     p->set_uniform(pipeline::UNIFORM_MODEL_MAT, model_mat);
 
-    // Ambient material
-    p->set_uniform(pipeline::UNIFORM_MATERIAL, r->m_mesh.get_material());
-
-    // Draw call
-    r->m_mesh.render();
+    // Draw calls; materials come from the material table
+    r->m_mesh.render(p);
 }
 
 REGISTER_PARSE_REF(renderer)
@@ -0,0 +1,91 @@
+#ifndef RESIDENCY_H
+#define RESIDENCY_H
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include <glad/glad.h>
+
+struct texture;
+
+// GPU memory that textures and render targets may use between them. The WebGL build runs inside a fixed
+// INITIAL_MEMORY, so it gets far less.
+#ifdef __EMSCRIPTEN__
+#   define DEFAULT_TEXTURE_MEMORY_BUDGET (128 * 1024 * 1024)
+#else
+#   define DEFAULT_TEXTURE_MEMORY_BUDGET (512 * 1024 * 1024)
+#endif
+
+// Mip levels this wide or smaller are never dropped, so every texture keeps a blurry version of itself
+#define RESIDENCY_MIN_LEVEL_WIDTH 64
+
+// Texels per screen pixel a texture is allowed before its next level down is enough; above one, so that a
+// slight overestimate of an object's size doesn't hold on to a whole extra level
+#define RESIDENCY_TEXEL_BIAS 1.5f
+
+// Keeps track of the GPU memory held by every texture and render target. Render targets are fixed, but each texture
+// reports how large it appears on screen every frame; when the total goes over budget, the largest mips of the textures
+// that have gone longest without being needed are dropped, by raising their base level. They're streamed back in from
+// their file once there's room for them and they're needed again.
+struct residency_manager {
+    public:
+        residency_manager() {}
+
+        residency_manager(const residency_manager&) = delete;
+        residency_manager& operator=(const residency_manager&) = delete;
+
+        void set_budget(std::size_t bytes) { m_budget = bytes; }
+        std::size_t budget() const { return m_budget; }
+
+        // Bytes currently held on the GPU by everything tracked
+        std::size_t used() const;
+
+        // Memory that is never given back, such as a framebuffer's attachments; type is GL_FRAMEBUFFER or GL_TEXTURE,
+        // as their names can coincide
+        void track_fixed(GLenum type, GLuint name, std::size_t bytes);
+        void untrack_fixed(GLenum type, GLuint name);
+
+        // The size of each of a texture's mip levels, largest first; called by the streamer once it knows them. A
+        // texture is counted as if all of the levels it is streaming were already up.
+        void track_texture(texture* t, int width, const std::vector<std::size_t>& level_bytes);
+        void untrack_texture(texture* t);
+
+        // The texture is drawn this frame at about this many pixels across
+        void need(texture* t, float pixels, unsigned int frame);
+
+        // Drops or restores mip levels to fit the budget; called once per frame, after need() for every visible texture
+        void update(unsigned int frame);
+
+    private:
+        struct tracked_texture {
+            int width { 0 };
+            std::vector<std::size_t> level_bytes {};
+
+            // Finest level on the GPU, or on its way there
+            int base_level { 0 };
+
+            // Finest level asked for during last_needed
+            int needed_level { 0 };
+            unsigned int last_needed { 0 };
+        };
+
+        static std::size_t bytes_from(const tracked_texture& tracked, int level);
+
+        // Coarsest level that may be kept as the finest one; the tail below it is never dropped
+        static int lowest_base(const tracked_texture& tracked);
+
+        void drop(texture* t, tracked_texture& tracked, int new_base);
+
+        void restore(texture* t, tracked_texture& tracked, int new_base);
+
+        std::unordered_map<texture*, tracked_texture> m_textures {};
+        std::unordered_map<std::uint64_t, std::size_t> m_fixed {};
+
+        std::size_t m_budget { DEFAULT_TEXTURE_MEMORY_BUDGET };
+};
+
+// Shared manager used by every texture and framebuffer
+residency_manager& residency();
+
+#endif
@@ -5,12 +5,20 @@
 #include <optional>
 #include <string>
 
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
 #include "arena.h"
+#include "bvh.h"
 #include "serialise.h"
 #include "scene_node.h"
 
 #define SCENE_ARENA_SIZE 1024 * 1024
 
+// Raycast masks select renderers by the pipeline they draw with
+#define RAYCAST_MASK(pipeline) (1u << (pipeline))
+#define RAYCAST_ALL 0xFFFFFFFF
+
 struct pipeline;
 struct application;
 
@@ -18,6 +26,15 @@ struct directional_light;
 struct point_light;
 struct camera;
 struct renderer;
+struct reflection_probe;
+
+struct raycast_hit {
+    scene_node* node { nullptr };
+    unsigned int submesh { 0 };
+    unsigned int triangle { 0 };
+    glm::vec3 point { 0, 0, 0 };
+    float distance { 0 };
+};
 
 struct scene {
     arena arena { SCENE_ARENA_SIZE };
@@ -30,7 +47,15 @@ struct scene {
     }
 
     inline void run(application* app) {
+
+        // Components may move during their update, so raycasts made then check for moves since the BVH was built
+        m_bvh_dirty = true;
+        m_running = true;
+
         root->run(app, this);
+
+        m_running = false;
+        m_bvh_dirty = true;
     }
 
     inline void render(application* app, pipeline* p) {
@@ -53,9 +78,42 @@ struct scene {
         return root->get_camera();
     }
 
-    inline std::optional<renderer*> get_water_renderer() {
-        return root->get_water_renderer();
+    inline std::vector<scene_node*> get_water_renderers() {
+        std::vector<scene_node*> nodes {};
+        root->get_water_renderers(nodes);
+        return nodes;
+    }
+
+    inline std::vector<reflection_probe*> get_reflection_probes() {
+        std::vector<reflection_probe*> probes {};
+        root->get_reflection_probes(probes);
+        return probes;
     }
+
+    // Closest renderer hit by the ray within max_t, considering only renderers whose pipeline is in mask
+    std::optional<raycast_hit> raycast(glm::vec3 origin, glm::vec3 dir, float max_t, unsigned int mask = RAYCAST_ALL);
+
+    // Casts every ray, spreading the work across the worker pool; hits[i] corresponds to rays[i]
+    void raycast_many(const std::vector<ray>& rays, float max_t, unsigned int mask,
+                      std::vector<std::optional<raycast_hit>>& hits);
+
+    private:
+        void build_bvh();
+
+        // Whether any renderer has moved since the BVH was built
+        bool bvh_moved() const;
+
+        std::optional<raycast_hit> trace(ray r, float max_t, unsigned int mask) const;
+
+        // Scene-level BVH over the world bounds of every renderer, rebuilt lazily after updates
+        bvh m_bvh {};
+        std::vector<scene_node*> m_bvh_nodes {};
+        std::vector<glm::mat4> m_bvh_models {};
+        std::vector<glm::mat4> m_bvh_inverse_models {};
+        bool m_bvh_dirty { true };
+
+        // Set while components update
+        bool m_running { false };
 };
 
 #endif
\ No newline at end of file
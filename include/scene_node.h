@@ -15,6 +15,7 @@ struct directional_light;
 struct point_light;
 struct camera;
 struct renderer;
+struct reflection_probe;
 
 struct scene_node {
     std::string name { "Object" };
@@ -37,8 +38,10 @@ struct scene_node {
 
     void get_directional_lights(std::vector<directional_light*>& lights);
     void get_point_lights(std::vector<point_light*>& lights);
+    void get_renderers(std::vector<scene_node*>& nodes);
     std::optional<camera*> get_camera();
-    std::optional<renderer*> get_water_renderer();
+    void get_water_renderers(std::vector<scene_node*>& nodes);
+    void get_reflection_probes(std::vector<reflection_probe*>& probes);
 };
 
 template<typename T>
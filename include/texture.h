@@ -8,21 +8,40 @@
 struct texture {
     private:
         GLenum m_texture_target;
-        GLuint m_texture_object;
+        GLuint m_texture_object { 0 };
         std::string m_file_name;
 
+        // Set while the streamer still has mips to upload
+        bool m_streaming { false };
+
+        // 2D array textures may be moved into a layer of an array shared with other textures, once another of the same
+        // size is known; the layer's levels finer than m_min_level haven't arrived yet
+        int m_layer { 0 };
+        bool m_shared { false };
+        int m_min_level { 0 };
+
+        friend struct texture_streamer;
+        friend struct residency_manager;
+
     public:
         texture(GLenum texture_target, std::string file_name) 
             : m_texture_target { texture_target }
             , m_file_name { file_name } {}
 
-        ~texture() {
-            glDeleteTextures(1, &m_texture_object);
-        }
+        ~texture();
 
+        // Returns straight away, with a placeholder in place of the image. The file is streamed in over the
+        // following frames, from its cooked, block compressed mip chain when there's one the driver can use.
+        // GL_TEXTURE_2D_ARRAY textures get a single layer.
         void load();
 
         void bind(GLenum texture_unit) const;
+
+        bool streaming() const { return m_streaming; }
+
+        GLuint object() const { return m_texture_object; }
+        int layer() const { return m_layer; }
+        int min_level() const { return m_min_level; }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,72 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <vector>
+#include <cstdint>
+
+#include <glad/glad.h>
+
+struct texture;
+
+// Layers in each shared array; the whole array is allocated up front, as GLES 3 can't copy between textures to grow it
+#define TEXTURE_ARRAY_LAYERS 8
+
+// Wider images keep an array of their own, so that the residency manager can still drop their top mips
+#define TEXTURE_ARRAY_MAX_WIDTH 1024
+
+// Mesh textures of the same size and format share GL_TEXTURE_2D_ARRAYs, one layer each, so that submeshes with different
+// materials can be drawn together; each material's layer is found through the material table. A texture stays in its own
+// array, where the residency manager can drop its top mips, until a second one of the same shape arrives; then both
+// are moved into a shared array, and the first is streamed again into its layer.
+struct texture_array_pool {
+    public:
+        texture_array_pool() {}
+
+        texture_array_pool(const texture_array_pool&) = delete;
+        texture_array_pool& operator=(const texture_array_pool&) = delete;
+
+        // Reserves a layer for a texture with this mip chain, in an array that has room, or in a new one if another
+        // texture of the same shape is waiting on its own. Returns false if the texture should keep its own array, as
+        // it's too wide or the first of its shape.
+        bool place(texture* t, int width, int height, GLenum internal_format, GLenum format, bool compressed,
+                   const std::vector<std::size_t>& level_bytes, GLuint& texture_object, int& layer);
+
+        // The layer's texture is going away; its layer can be reused, and the array is freed once it's empty
+        void release(GLuint texture_object, int layer);
+
+        // A texture with its own array is going away
+        void forget(texture* t);
+
+    private:
+        struct texture_array {
+            GLuint texture_object { 0 };
+
+            int width { 0 };
+            int height { 0 };
+            GLenum internal_format { 0 };
+            int levels { 0 };
+
+            // Bytes of one layer's whole mip chain
+            std::size_t layer_bytes { 0 };
+
+            std::vector<bool> used {};
+        };
+
+        // A texture left in its own array, and the shape it would share with
+        struct waiting_texture {
+            texture* t { nullptr };
+
+            int width { 0 };
+            int height { 0 };
+            GLenum internal_format { 0 };
+            int levels { 0 };
+        };
+
+        std::vector<texture_array> m_arrays {};
+        std::vector<waiting_texture> m_waiting {};
+};
+
+// Shared pool used by every mesh texture
+texture_array_pool& texture_arrays();
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include <glad/glad.h>
+
+struct texture;
+
+// Most bytes of texture data uploaded per frame; a mip larger than this still goes up on its own
+#define TEXTURE_UPLOAD_BUDGET (4 * 1024 * 1024)
+
+// Without worker threads, as in WebGL, decodes run on the GL thread in update() until this many milliseconds have
+// gone by in a frame; a decode that takes longer still finishes, so at least one is done each frame
+#define TEXTURE_DECODE_BUDGET_MS 4.0f
+
+// Textures are decoded, and their mip chains built, as background work on the worker pool, behind the frame's own
+// jobs. Finished decodes are pushed onto a lock-free list, and then uploaded from the GL thread a few mips at a time,
+// smallest first, so that each texture starts blurry and sharpens as its larger mips arrive. Until its first mip is
+// up, a texture shows a 1x1 placeholder.
+struct texture_streamer {
+    public:
+        texture_streamer() {}
+
+        ~texture_streamer();
+
+        texture_streamer(const texture_streamer&) = delete;
+        texture_streamer& operator=(const texture_streamer&) = delete;
+
+        // Start decoding a texture's file; it must have its placeholder, or the levels coarser than first_level,
+        // already. Only levels first_level to last_level are uploaded, every one of them if last_level is -1.
+        void request(texture* t, const std::string& file_name, int first_level = 0, int last_level = -1);
+
+        // The texture is going away; anything still to be uploaded to it is dropped
+        void cancel(texture* t);
+
+        // Streams the whole of a texture into a layer reserved for it in a shared array, which it moves into when the
+        // first mip is uploaded; it keeps showing what it has until then
+        void move_to_layer(texture* t, GLuint array, int layer);
+
+        // Upload up to budget bytes of decoded mips; called once per frame on the GL thread
+        void update(std::size_t budget);
+
+        // Whether every requested texture has been fully uploaded
+        bool idle() const { return m_requests.empty(); }
+
+    private:
+        struct mip {
+            int width { 0 };
+            int height { 0 };
+            std::vector<unsigned char> data {};
+        };
+
+        // A decoded texture, largest mip first, and how far its upload has got
+        struct decoded {
+            std::uint64_t request { 0 };
+            std::string file_name {};
+            std::string error {};
+
+            bool compressed { false };
+            GLenum internal_format { 0 };
+            GLenum format { 0 };
+
+            std::vector<mip> mips {};
+            int first_level { 0 };
+            int last_level { -1 };
+            int next_level { -1 };
+
+            // Layer reserved in a shared texture array; the texture moves into it when the first mip is uploaded
+            GLuint array { 0 };
+            int layer { 0 };
+
+            decoded* next { nullptr };
+        };
+
+        void start(texture* t, const std::string& file_name, int first_level, int last_level, GLuint array, int layer);
+
+        static void decode(decoded& d, const std::vector<GLenum>& compressed_formats);
+
+        void push(decoded* d);
+
+        void upload(texture* t, decoded& d, int level);
+
+        // Decodes finished by the workers, newest first
+        std::atomic<decoded*> m_completed { nullptr };
+
+        // Decodes taken from m_completed that still have mips to upload
+        std::vector<decoded*> m_uploading {};
+
+#ifdef __EMSCRIPTEN__
+        // Requests waiting for update() to decode them, oldest first
+        std::vector<decoded*> m_pending {};
+#endif
+
+        // Outstanding requests, so that cancelled textures can be recognised when their decode arrives
+        std::unordered_map<std::uint64_t, texture*> m_requests {};
+        std::uint64_t m_next_request { 1 };
+
+        // Block compressed formats the driver takes, found on the first request
+        std::vector<GLenum> m_compressed_formats {};
+        bool m_formats_known { false };
+
+        GLuint m_pbo { 0 };
+};
+
+// Shared streamer used by every texture
+texture_streamer& texture_stream();
+
+#endif
@@ -16,8 +16,8 @@
 #define SPECULAR_TEX_UNIT_INDEX 1
 #define DEPTH_TEX_UNIT0         GL_TEXTURE2
 #define DEPTH_TEX_UNIT0_INDEX   2
-// #define DEPTH_TEX_UNIT1         GL_TEXTURE3
-// #define DEPTH_TEX_UNIT1_INDEX   3
+#define SHADOW_TEX_UNIT         GL_TEXTURE3
+#define SHADOW_TEX_UNIT_INDEX   3
 #define NOISE_TEX_UNIT          GL_TEXTURE4
 #define NOISE_TEX_UNIT_INDEX    4
 #define DUDV_TEX_UNIT           GL_TEXTURE5
@@ -28,6 +28,28 @@
 #define REFRACT_TEX_UNIT_INDEX  7
 #define NORMAL_TEX_UNIT         GL_TEXTURE8
 #define NORMAL_TEX_UNIT_INDEX   8
+#define LIGHTS_TEX_UNIT         GL_TEXTURE9
+#define LIGHTS_TEX_UNIT_INDEX   9
+#define CLUSTERS_TEX_UNIT       GL_TEXTURE10
+#define CLUSTERS_TEX_UNIT_INDEX 10
+#define LIGHT_INDICES_TEX_UNIT  GL_TEXTURE11
+#define LIGHT_INDICES_TEX_UNIT_INDEX 11
+#define GBUFFER_AMBIENT_TEX_UNIT        GL_TEXTURE12
+#define GBUFFER_AMBIENT_TEX_UNIT_INDEX  12
+#define GBUFFER_DIFFUSE_TEX_UNIT        GL_TEXTURE13
+#define GBUFFER_DIFFUSE_TEX_UNIT_INDEX  13
+#define GBUFFER_SPECULAR_TEX_UNIT       GL_TEXTURE14
+#define GBUFFER_SPECULAR_TEX_UNIT_INDEX 14
+#define GBUFFER_NORMAL_TEX_UNIT         GL_TEXTURE15
+#define GBUFFER_NORMAL_TEX_UNIT_INDEX   15
+#define DEPTH_PYRAMID_TEX_UNIT          GL_TEXTURE16
+#define DEPTH_PYRAMID_TEX_UNIT_INDEX    16
+#define PROBE_TEX_UNIT0                 GL_TEXTURE17
+#define PROBE_TEX_UNIT0_INDEX           17
+#define PROBE_TEX_UNIT1                 GL_TEXTURE18
+#define PROBE_TEX_UNIT1_INDEX           18
+#define MATERIAL_TABLE_TEX_UNIT         GL_TEXTURE19
+#define MATERIAL_TABLE_TEX_UNIT_INDEX   19
 
 const int i = GL_TEXTURE0;
 
@@ -35,6 +57,18 @@ const int i = GL_TEXTURE0;
 
 void display_gl_version_info();
 
+// Whether glClipControl can be used; it's core in GL 4.5, and never available in WebGL
+bool gl_has_clip_control();
+
+// Whether textures in this block compressed format can be uploaded
+bool gl_has_compressed_format(GLenum internal_format);
+
+// Whether linked programs can be saved and reloaded; WebGL has no glGetProgramBinary
+bool gl_has_program_binary();
+
+// Whether the driver can compile shaders on its own threads, which it's then asked to use
+bool gl_enable_parallel_shader_compile();
+
 void clear_gl_errors();
 
 void process_gl_errors(const char* fn_call, int line_no);
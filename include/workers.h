@@ -0,0 +1,59 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Persistent pool of worker threads. The WebGL build is compiled without pthreads, so there
+// the pool has no threads and every job runs inline on the calling thread.
+//
+// Jobs come in two priorities: frame work, such as parallel_for's chunks, which is always taken first, and
+// background work, such as texture decodes, which never takes more than all but one of the threads.
+struct workers {
+    public:
+        workers();
+
+        ~workers();
+
+        workers(const workers&) = delete;
+        workers& operator=(const workers&) = delete;
+
+        // Queue a job to run on some worker thread at some point in the future
+        void submit(std::function<void()> job);
+
+        // Queue a job that may take several frames, behind any frame work
+        void submit_background(std::function<void()> job);
+
+        // Split [0, count) into chunks of at least `grain` items and run fn(begin, end) on each chunk.
+        // The calling thread works through the chunks too, but never picks up other jobs, and only returns
+        // once every chunk is done.
+        void parallel_for(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)>& fn);
+
+        // Number of threads that work can be spread over, including the caller
+        unsigned int concurrency() const { return m_threads.size() + 1; }
+
+    private:
+        void work();
+
+        std::vector<std::thread> m_threads {};
+        std::deque<std::function<void()>> m_jobs {};
+        std::deque<std::function<void()>> m_background {};
+
+        // Background jobs being run, which are kept under the number of threads
+        unsigned int m_background_running { 0 };
+
+        std::mutex m_mutex {};
+        std::condition_variable m_wake {};
+
+        bool m_stopping { false };
+};
+
+// Shared pool used by engine systems
+workers& worker_pool();
+
+#endif
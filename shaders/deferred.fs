@@ -0,0 +1,48 @@
+#version 300 es
+
+precision highp float;
+precision highp sampler2D;
+precision highp sampler2DArrayShadow;
+precision highp usampler2D;
+
+#include "lighting.glsl"
+
+// G-buffer
+uniform sampler2D u_sampler_gbuffer_ambient;
+uniform sampler2D u_sampler_gbuffer_diffuse;
+uniform sampler2D u_sampler_gbuffer_specular;
+uniform sampler2D u_sampler_gbuffer_normal;
+uniform sampler2D u_sampler_depth0;
+
+uniform mat4 u_inv_view_matrix;
+
+uniform float u_cam_near;
+
+// Output
+out vec4 out_color;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+
+    // Nothing was drawn here, so leave the sky
+    float depth = texelFetch(u_sampler_depth0, pixel, 0).r;
+    if (depth <= 0.0f) discard;
+
+    // Reversed depth is near / w; walk the view distance along the pixel's view ray
+    float w = u_cam_near / depth;
+    vec2 ndc = (gl_FragCoord.xy / vec2(textureSize(u_sampler_depth0, 0))) * 2.0f - 1.0f;
+    vec3 view_pos = vec3(ndc.x * w / u_proj_matrix[0][0], ndc.y * w / u_proj_matrix[1][1], -w);
+
+    vec4 specular = texelFetch(u_sampler_gbuffer_specular, pixel, 0);
+
+    surface s;
+    s.world_pos = (u_inv_view_matrix * vec4(view_pos, 1.0f)).xyz;
+    s.normal = normalize(texelFetch(u_sampler_gbuffer_normal, pixel, 0).xyz * 2.0f - 1.0f);
+    s.ambient_color = texelFetch(u_sampler_gbuffer_ambient, pixel, 0).rgb;
+    s.diffuse_color = texelFetch(u_sampler_gbuffer_diffuse, pixel, 0).rgb;
+    s.specular_color = specular.rgb;
+    s.specular_exponent = specular.a * 255.0f;
+    s.view_depth = w;
+
+    out_color = vec4(calc_lighting(s), 1.0f);
+}
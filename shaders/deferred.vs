@@ -0,0 +1,7 @@
+#version 300 es
+
+// Full screen triangle, with no vertex buffer
+void main() {
+    vec2 corner = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+    gl_Position = vec4(corner * 2.0f - 1.0f, 0.0f, 1.0f);
+}
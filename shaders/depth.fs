@@ -0,0 +1,3 @@
+#version 300 es
+
+void main() {}
\ No newline at end of file
@@ -0,0 +1,17 @@
+#version 300 es
+
+in vec3 in_position;
+in vec2 in_texcoord0;
+in vec3 in_normal;
+
+uniform mat4 u_model_matrix;
+uniform mat4 u_view_matrix;
+uniform mat4 u_proj_matrix;
+
+// Must be computed exactly as in phong.vs, so that the lighting pass passes the depth test against this depth
+invariant gl_Position;
+
+void main() {
+    vec4 world_pos = u_model_matrix * vec4(in_position, 1.0f);
+    gl_Position = u_proj_matrix * u_view_matrix * world_pos;
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+#version 300 es
+
+precision highp float;
+
+// The level before this one; the full resolution depth buffer for the first level
+uniform highp sampler2D u_sampler_depth0;
+
+// Each texel keeps the nearest depth of the 2x2 block it covers, which with reversed-Z is the greatest
+void main() {
+    ivec2 size = textureSize(u_sampler_depth0, 0);
+    ivec2 last = size - 1;
+    ivec2 base = ivec2(gl_FragCoord.xy) * 2;
+
+    // Odd sized levels leave a row or column over, which the last texel also covers
+    ivec2 extent = ivec2(2) + ivec2(equal(base + 3, size));
+
+    float depth = 0.0f;
+
+    for (int y = 0 ; y < extent.y ; y += 1) {
+        for (int x = 0 ; x < extent.x ; x += 1) {
+            depth = max(depth, texelFetch(u_sampler_depth0, min(base + ivec2(x, y), last), 0).x);
+        }
+    }
+
+    gl_FragDepth = depth;
+}
@@ -0,0 +1,26 @@
+#version 300 es
+
+precision highp float;
+precision mediump sampler2DArray;
+
+#include "material.glsl"
+
+// Per-vertex data
+in vec3 v_world_pos;
+in vec2 v_texcoord0;
+in vec3 v_normal;
+
+// G-buffer; material colours are stored already multiplied by the albedo
+layout(location = 0) out vec4 out_ambient;
+layout(location = 1) out vec4 out_diffuse;
+layout(location = 2) out vec4 out_specular;
+layout(location = 3) out vec4 out_normal;
+
+void main() {
+    vec3 albedo = material_albedo(v_texcoord0).rgb;
+
+    out_ambient = vec4(albedo * v_material_ambient.rgb, 1.0f);
+    out_diffuse = vec4(albedo * v_material_diffuse.rgb, 1.0f);
+    out_specular = vec4(albedo * v_material_specular.rgb, material_specular_exponent(v_texcoord0) / 255.0f);
+    out_normal = vec4(normalize(v_normal) * 0.5f + 0.5f, 1.0f);
+}
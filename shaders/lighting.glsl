@@ -0,0 +1,287 @@
+// Shared lighting code for phong.fs and deferred.fs, pulled in with #include. Expects float,
+// sampler2DArrayShadow and usampler2D precisions to have been declared by the includer; the point
+// light texture declares its own, as it holds world space positions and ranges.
+// The pipeline's feature defines select what's compiled in: SHADOWS and POINT_LIGHTS enable those
+// lights' contributions, PCF_KERNEL picks the shadow filter, and REFLECTION reduces shadows to a
+// single filtered tap.
+
+// One of the SHADOW_QUALITY_* values in directional_light.h
+#ifndef PCF_KERNEL
+#define PCF_KERNEL 1
+#endif
+
+// Point light clusters; must match clusters.h
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+const int CLUSTER_INDEX_TEXTURE_WIDTH = 1024;
+
+const int MAX_DIR_LIGHTS = 10;
+const int MAX_SHADOW_CASCADES = 4;
+const float SHADOW_CASCADE_BLEND_BAND = 0.1f;
+
+const int POISSON_TAPS = 8;
+const vec2 POISSON_DISK[POISSON_TAPS] = vec2[](
+    vec2(-0.94201624f, -0.39906216f), vec2(0.94558609f, -0.76890725f), vec2(-0.09418410f, -0.92938870f),
+    vec2(0.34495938f, 0.29387760f), vec2(-0.91588581f, 0.45771432f), vec2(-0.81544232f, -0.87912464f),
+    vec2(-0.38277543f, 0.27676845f), vec2(0.97484398f, 0.75648379f)
+);
+const float POISSON_RADIUS = 2.0f;
+
+struct light {
+    vec3 color;
+    float ambient_intensity;
+    float diffuse_intensity;
+    float specular_intensity;
+};
+
+struct dir_light {
+    light base;
+    vec3 direction;
+};
+
+struct point_light {
+    light base;
+    vec3 world_pos;
+    float attn_const;
+    float attn_linear;
+    float attn_exp;
+};
+
+// Everything the lighting functions need to know about the point being lit. Colours are
+// the material's, already multiplied by the surface's albedo.
+struct surface {
+    vec3 world_pos;
+    vec3 normal;
+    vec3 ambient_color;
+    vec3 diffuse_color;
+    vec3 specular_color;
+    float specular_exponent;
+    float view_depth;
+};
+
+// Lighting data
+uniform int u_num_dir_lights;
+uniform dir_light u_dir_lights[MAX_DIR_LIGHTS];
+
+// Point lights, and the list of lights touching each cluster
+uniform highp sampler2D u_sampler_lights;
+uniform usampler2D u_sampler_clusters;
+uniform usampler2D u_sampler_light_indices;
+uniform vec2 u_cluster_depth;
+
+uniform mat4 u_view_matrix;
+uniform mat4 u_proj_matrix;
+
+// Shadow cascades, with the view distance at which each one ends
+uniform int u_num_cascades;
+uniform mat4 u_shadow_matrices[MAX_SHADOW_CASCADES];
+uniform float u_cascade_splits[MAX_SHADOW_CASCADES];
+uniform float u_shadow_texel_size;
+
+uniform sampler2DArrayShadow u_sampler_shadow;
+uniform sampler2D u_sampler_noise;
+
+uniform vec3 u_camera_pos;
+
+vec3 calc_base_light(light base, vec3 direction, float shadow_factor, surface s) {
+    vec3 ambient_color = base.color * s.ambient_color * base.ambient_intensity;
+
+    float diffuse = clamp(dot(s.normal, -normalize(direction)), 0.0f, 1.0f);
+    vec3 diffuse_color = base.color * s.diffuse_color * base.diffuse_intensity * diffuse;
+
+    vec3 pixel_to_cam = normalize(u_camera_pos - s.world_pos);
+    vec3 reflection = normalize(reflect(direction, s.normal));
+    float specular_base = clamp(dot(pixel_to_cam, reflection), 0.0f, 1.0f);
+    float specular = 0.0f;
+    if (s.specular_exponent > 0.0f) specular = clamp(pow(specular_base, s.specular_exponent), 0.0f, 1.0f);
+    
+    vec3 specular_color = base.color * s.specular_color * base.specular_intensity * specular;
+
+    return ambient_color + (diffuse_color + specular_color) * shadow_factor;
+}
+
+vec3 calc_point_light(point_light light, surface s) {
+    vec3 dir = s.world_pos - light.world_pos;
+    vec3 unscaled_emission = calc_base_light(light.base, dir, 1.0f, s);
+
+    float d = length(dir);
+    float scale_factor = light.attn_const + light.attn_linear * d + light.attn_exp * d * d;
+
+    return unscaled_emission / scale_factor;
+}
+
+// One hardware comparison, bilinearly filtered across the four nearest texels
+float sample_shadow(vec2 uv, float layer, float z) {
+    return texture(u_sampler_shadow, vec4(uv, layer, z));
+}
+
+// Four bilinear taps, half a texel apart, giving smooth 3x3 texel filtering
+float calc_shadow_bilinear(vec2 uv, float layer, float z) {
+    float o = 0.5f * u_shadow_texel_size;
+
+    float shadow = sample_shadow(uv + vec2(-o, -o), layer, z);
+    shadow += sample_shadow(uv + vec2(o, -o), layer, z);
+    shadow += sample_shadow(uv + vec2(-o, o), layer, z);
+    shadow += sample_shadow(uv + vec2(o, o), layer, z);
+
+    return shadow * 0.25f;
+}
+
+// 5x5 texel tent filter built from nine bilinear taps, with weights and offsets chosen so that
+// the filtering hardware does most of the work
+float calc_shadow_gaussian(vec2 uv, float layer, float z) {
+    vec2 texel_uv = uv / u_shadow_texel_size;
+    vec2 base_uv = floor(texel_uv + 0.5f);
+    vec2 st = texel_uv + 0.5f - base_uv;
+    base_uv = (base_uv - 0.5f) * u_shadow_texel_size;
+
+    vec3 uw = vec3(4.0f - 3.0f * st.x, 7.0f, 1.0f + 3.0f * st.x);
+    vec3 u = vec3((3.0f - 2.0f * st.x) / uw.x - 2.0f, (3.0f + st.x) / uw.y, st.x / uw.z + 2.0f) * u_shadow_texel_size;
+
+    vec3 vw = vec3(4.0f - 3.0f * st.y, 7.0f, 1.0f + 3.0f * st.y);
+    vec3 v = vec3((3.0f - 2.0f * st.y) / vw.x - 2.0f, (3.0f + st.y) / vw.y, st.y / vw.z + 2.0f) * u_shadow_texel_size;
+
+    float shadow = 0.0f;
+
+    for (int y = 0 ; y < 3 ; y += 1) {
+        for (int x = 0 ; x < 3 ; x += 1) {
+            shadow += uw[x] * vw[y] * sample_shadow(base_uv + vec2(u[x], v[y]), layer, z);
+        }
+    }
+
+    return shadow / 144.0f;
+}
+
+// Poisson disk, rotated per pixel by the noise texture, which trades banding for fine noise
+float calc_shadow_poisson(vec2 uv, float layer, float z) {
+    float angle = texture(u_sampler_noise, gl_FragCoord.xy / 256.0f).r * 6.2831853f;
+    float c = cos(angle);
+    float s = sin(angle);
+    mat2 rotation = mat2(c, s, -s, c);
+
+    float shadow = 0.0f;
+
+    for (int i = 0 ; i < POISSON_TAPS ; i += 1) {
+        vec2 offset = rotation * POISSON_DISK[i] * POISSON_RADIUS * u_shadow_texel_size;
+        shadow += sample_shadow(uv + offset, layer, z);
+    }
+
+    return shadow / float(POISSON_TAPS);
+}
+
+point_light fetch_point_light(int index) {
+    vec4 position = texelFetch(u_sampler_lights, ivec2(index, 0), 0);
+    vec4 color = texelFetch(u_sampler_lights, ivec2(index, 1), 0);
+    vec4 intensity = texelFetch(u_sampler_lights, ivec2(index, 2), 0);
+    vec4 attenuation = texelFetch(u_sampler_lights, ivec2(index, 3), 0);
+
+    point_light light;
+    light.base.color = color.rgb;
+    light.base.ambient_intensity = color.a;
+    light.base.diffuse_intensity = intensity.x;
+    light.base.specular_intensity = intensity.y;
+    light.world_pos = position.xyz;
+    light.attn_const = attenuation.x;
+    light.attn_linear = attenuation.y;
+    light.attn_exp = attenuation.z;
+    return light;
+}
+
+// Only the lights whose range reaches this fragment's cluster are considered
+vec3 calc_clustered_point_lights(surface s) {
+    vec4 view_pos = u_view_matrix * vec4(s.world_pos, 1.0f);
+    vec4 clip_pos = u_proj_matrix * view_pos;
+    vec2 ndc = clip_pos.xy / clip_pos.w;
+
+    int x = clamp(int((ndc.x * 0.5f + 0.5f) * float(CLUSTER_X)), 0, CLUSTER_X - 1);
+    int y = clamp(int((ndc.y * 0.5f + 0.5f) * float(CLUSTER_Y)), 0, CLUSTER_Y - 1);
+    int z = clamp(int(log(max(-view_pos.z, u_cluster_depth.x) / u_cluster_depth.x) / u_cluster_depth.y * float(CLUSTER_Z)), 0, CLUSTER_Z - 1);
+
+    uvec2 cluster = texelFetch(u_sampler_clusters, ivec2(y * CLUSTER_X + x, z), 0).rg;
+
+    vec3 total = vec3(0.0f, 0.0f, 0.0f);
+
+    for (uint i = 0u ; i < cluster.y ; i += 1u) {
+        int entry = int(cluster.x + i);
+        int index = int(texelFetch(u_sampler_light_indices, ivec2(entry % CLUSTER_INDEX_TEXTURE_WIDTH, entry / CLUSTER_INDEX_TEXTURE_WIDTH), 0).r);
+        total += calc_point_light(fetch_point_light(index), s);
+    }
+
+    return total;
+}
+
+float calc_cascade_shadow(int cascade, float bias, vec3 world_pos) {
+    vec4 lightspace_pos = u_shadow_matrices[cascade] * vec4(world_pos, 1.0f);
+    vec2 uv = vec2(0.5f * lightspace_pos.x + 0.5f, 0.5f * lightspace_pos.y + 0.5f);
+    float z = 0.5f * lightspace_pos.z + 0.5f;
+
+    // If any geometry on screen is beyond in the shadow map, set it to be without shadows
+    if (z >= 1.0f) return 1.0f;
+
+    float layer = float(cascade);
+    z -= bias;
+
+#if defined(REFLECTION)
+    return sample_shadow(uv, layer, z);
+#elif PCF_KERNEL == 2
+    return calc_shadow_poisson(uv, layer, z);
+#elif PCF_KERNEL == 1
+    return calc_shadow_gaussian(uv, layer, z);
+#else
+    return calc_shadow_bilinear(uv, layer, z);
+#endif
+}
+
+float calc_dir_light_shadow(vec3 light_direction, surface s) {
+    float diffuse = clamp(dot(s.normal, -normalize(light_direction)), 0.0f, 1.0f);
+    float bias = mix(0.025f, 0.001f, diffuse);
+
+    // Pick the first cascade that reaches this far from the camera
+    int cascade = u_num_cascades;
+    for (int i = 0 ; i < u_num_cascades ; i += 1) {
+        if (s.view_depth < u_cascade_splits[i]) {
+            cascade = i;
+            break;
+        }
+    }
+
+    if (cascade >= u_num_cascades) return 1.0f;
+
+    float shadow = calc_cascade_shadow(cascade, bias, s.world_pos);
+
+    // Fade into the next cascade (or out of shadow, after the last) across the far end of this one
+    float cascade_near = cascade > 0 ? u_cascade_splits[cascade - 1] : 0.0f;
+    float band = (u_cascade_splits[cascade] - cascade_near) * SHADOW_CASCADE_BLEND_BAND;
+    float blend = clamp((s.view_depth - (u_cascade_splits[cascade] - band)) / band, 0.0f, 1.0f);
+
+    if (blend > 0.0f) {
+        float next = cascade + 1 < u_num_cascades ? calc_cascade_shadow(cascade + 1, bias, s.world_pos) : 1.0f;
+        shadow = mix(shadow, next, blend);
+    }
+
+    return shadow;
+}
+
+vec3 calc_dir_light(dir_light light, surface s) {
+#ifdef SHADOWS
+    return calc_base_light(light.base, light.direction, calc_dir_light_shadow(light.direction, s), s);
+#else
+    return calc_base_light(light.base, light.direction, 1.0f, s);
+#endif
+}
+
+// Total light reaching the surface, from every directional light and the point lights in its cluster
+vec3 calc_lighting(surface s) {
+    vec3 total_light = vec3(0.0f, 0.0f, 0.0f);
+
+    for (int i = 0 ; i < u_num_dir_lights ; i += 1) {
+        total_light += calc_dir_light(u_dir_lights[i], s);
+    }
+
+#ifdef POINT_LIGHTS
+    total_light += calc_clustered_point_lights(s);
+#endif
+
+    return total_light;
+}
@@ -0,0 +1,39 @@
+// Shared material lookup for phong.fs and gbuffer.fs, pulled in with #include. Expects float and sampler2DArray
+// precisions to have been declared by the includer. Colours and texture layers come from the material table, fetched
+// per vertex by phong.vs; textures are layers of the arrays bound for the draw.
+
+flat in vec4 v_material_ambient;    // ambient colour, diffuse texture layer
+flat in vec4 v_material_diffuse;    // diffuse colour, specular texture layer
+flat in vec4 v_material_specular;   // specular colour
+flat in vec4 v_material_levels;     // finest diffuse and specular levels that have streamed in
+
+uniform sampler2DArray u_sampler_diffuse;
+#ifdef SPECULAR_MAP
+uniform sampler2DArray u_sampler_specular;
+#endif
+
+// Trilinear filtering with the level worked out here, so that it can be kept off levels that haven't arrived yet.
+// Materials without a texture have a layer of -1, and get the fallback; the lookup itself isn't branched around,
+// as its derivatives need every pixel of the quad.
+vec4 sample_material_texture(sampler2DArray s, vec2 uv, float layer, float min_level, vec4 fallback) {
+    vec2 texels = uv * vec2(textureSize(s, 0).xy);
+    vec2 dx = dFdx(texels);
+    vec2 dy = dFdy(texels);
+    float lod = 0.5f * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8f));
+
+    vec4 texel = textureLod(s, vec3(uv, max(layer, 0.0f)), max(lod, min_level));
+    return layer < 0.0f ? fallback : texel;
+}
+
+vec4 material_albedo(vec2 uv) {
+    return sample_material_texture(u_sampler_diffuse, uv, v_material_ambient.w, v_material_levels.x, vec4(1.0f));
+}
+
+// Specular exponent from the specular map's red channel; none without one
+float material_specular_exponent(vec2 uv) {
+#ifdef SPECULAR_MAP
+    return sample_material_texture(u_sampler_specular, uv, v_material_diffuse.w, v_material_levels.y, vec4(0.0f)).r * 255.0f;
+#else
+    return 0.0f;
+#endif
+}
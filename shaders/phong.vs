@@ -3,24 +3,29 @@
 in vec3 in_position;
 in vec2 in_texcoord0;
 in vec3 in_normal;
+layout(location = 3) in uint in_material;
 
 uniform mat4 u_model_matrix;
 uniform mat4 u_view_matrix;
 uniform mat4 u_proj_matrix;
 
-uniform mat4 u_shadow_matrix;
-
-uniform vec4 u_clip_plane;
-uniform float u_clip_enabled;
+// One column per material; see material_table.h
+uniform highp sampler2D u_sampler_materials;
 
 out vec3 v_world_pos;
 out vec2 v_texcoord0;
 out vec3 v_normal;
-out vec4 v_lightspace_pos;
+
+// The vertex's material, read by material.glsl
+flat out vec4 v_material_ambient;
+flat out vec4 v_material_diffuse;
+flat out vec4 v_material_specular;
+flat out vec4 v_material_levels;
 
 out float v_w;
 
-out float v_clip;
+// The depth pre-pass in depth.vs relies on this position being reproduced exactly
+invariant gl_Position;
 
 void main() {
     vec4 world_pos = u_model_matrix * vec4(in_position, 1.0f);
@@ -30,7 +35,9 @@ void main() {
     v_texcoord0 = in_texcoord0;
     v_normal = (u_model_matrix * vec4(in_normal, 0.0f)).rgb;
 
-    v_lightspace_pos = u_shadow_matrix * u_model_matrix * vec4(in_position, 1.0f);
-
-    v_clip = dot(vec4(v_world_pos, 1.0f), u_clip_plane) * u_clip_enabled;
+    int material = int(in_material);
+    v_material_ambient = texelFetch(u_sampler_materials, ivec2(material, 0), 0);
+    v_material_diffuse = texelFetch(u_sampler_materials, ivec2(material, 1), 0);
+    v_material_specular = texelFetch(u_sampler_materials, ivec2(material, 2), 0);
+    v_material_levels = texelFetch(u_sampler_materials, ivec2(material, 3), 0);
 }
\ No newline at end of file
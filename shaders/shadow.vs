@@ -10,4 +10,7 @@ uniform mat4 u_shadow_matrix;
 
 void main() {
     gl_Position = u_shadow_matrix * u_model_matrix * vec4(in_position, 1.0f);
+
+    // Flatten anything between the light and the near plane onto it, rather than clipping it away
+    gl_Position.z = max(gl_Position.z, -gl_Position.w);
 }
\ No newline at end of file
@@ -0,0 +1,39 @@
+#version 300 es
+
+precision highp float;
+
+// The camera's view, drawn at a fraction of the window's size
+uniform sampler2D u_sampler_color;
+
+in vec2 v_uv;
+
+out vec4 out_color;
+
+// Catmull-Rom over the 4x4 texels around the sample, which keeps the edges a bilinear stretch would blur. The weights
+// of each middle pair are merged into one bilinear fetch, and the corners are dropped, leaving 5 fetches.
+void main() {
+    vec2 size = vec2(textureSize(u_sampler_color, 0));
+    vec2 position = v_uv * size;
+    vec2 centre = floor(position - 0.5f) + 0.5f;
+    vec2 f = position - centre;
+
+    vec2 w0 = f * (-0.5f + f * (1.0f - 0.5f * f));
+    vec2 w1 = 1.0f + f * f * (-2.5f + 1.5f * f);
+    vec2 w2 = f * (0.5f + f * (2.0f - 1.5f * f));
+    vec2 w3 = f * f * (-0.5f + 0.5f * f);
+
+    vec2 w12 = w1 + w2;
+    vec2 uv0 = (centre - 1.0f) / size;
+    vec2 uv12 = (centre + w2 / w12) / size;
+    vec2 uv3 = (centre + 2.0f) / size;
+
+    vec4 color = texture(u_sampler_color, vec2(uv12.x, uv0.y)) * w12.x * w0.y +
+                 texture(u_sampler_color, vec2(uv0.x, uv12.y)) * w0.x * w12.y +
+                 texture(u_sampler_color, vec2(uv12.x, uv12.y)) * w12.x * w12.y +
+                 texture(u_sampler_color, vec2(uv3.x, uv12.y)) * w3.x * w12.y +
+                 texture(u_sampler_color, vec2(uv12.x, uv3.y)) * w12.x * w3.y;
+
+    // Without the corners the weights no longer sum to one, and the negative lobes can overshoot
+    float weight = w12.x * w0.y + w0.x * w12.y + w12.x * w12.y + w3.x * w12.y + w12.x * w3.y;
+    out_color = vec4(clamp(color.rgb / weight, 0.0f, 1.0f), 1.0f);
+}
@@ -27,21 +27,62 @@ uniform dir_light u_dir_lights[MAX_DIR_LIGHTS];
 
 uniform sampler2D u_sampler_reflection;
 uniform sampler2D u_sampler_refraction;
-uniform sampler2D u_sampler_depth0;
+uniform highp sampler2D u_sampler_depth0;
 uniform sampler2D u_sampler_dudv;
 uniform sampler2D u_sampler_normal;
 
+uniform highp sampler2D u_sampler_depth_pyramid;
+uniform int u_depth_pyramid_levels;
+
+const int MAX_BLENDED_PROBES = 2;
+
+// The box is in world space
+struct reflection_probe {
+    vec3 position;
+    vec3 box_min;
+    vec3 box_max;
+    float radius;
+};
+
+uniform int u_num_probes;
+uniform reflection_probe u_probes[MAX_BLENDED_PROBES];
+uniform samplerCube u_sampler_probe0;
+uniform samplerCube u_sampler_probe1;
+
 uniform vec3 u_camera_pos;
 
+uniform mat4 u_view_matrix;
+uniform mat4 u_proj_matrix;
+
+// The view and projection the reflection was last drawn with; it isn't redrawn every frame
+uniform mat4 u_reflection_matrix;
+
+// The refraction copy's window depth is dot(u_refraction_depth, view_pos) / w
+uniform vec4 u_refraction_depth;
+
 uniform float u_time;
 
+uniform float u_cam_near;
 uniform float u_cam_far;
 
+// WATER_REFLECTION_PLANAR, WATER_REFLECTION_SCREEN_SPACE or WATER_REFLECTION_PROBE
+uniform int u_reflection_mode;
+uniform float u_reflection_distance;
+uniform vec3 u_sky_color;
+
 out vec4 out_color;
 
+const int REFLECTION_PLANAR = 0;
+const int REFLECTION_SCREEN_SPACE = 1;
+
 const float distortion_strength = 0.0075f;
 const float time_factor = 0.01f;
 
+// Screen-space reflection budget; a march step is one texel at the current depth pyramid level
+const int ssr_steps = 32;
+const float ssr_thickness = 1.0f;
+const float ssr_edge_fade = 0.1f;
+
 vec4 calc_light(dir_light d_light, vec3 base_color, vec3 normal) {
     light base = d_light.base;
     vec3 direction = d_light.direction;
@@ -59,20 +100,142 @@ vec4 calc_light(dir_light d_light, vec3 base_color, vec3 normal) {
     return specular_color;
 }
 
+// Marches a reflected view-space ray across the copy of the main view. Empty space is crossed at coarser and
+// coarser levels of the depth pyramid, dropping back a level whenever the ray might pass behind something.
+// Returns the uv that was hit, and how much to trust it in z; z is zero on a miss.
+vec3 trace_screen_space(vec3 view_pos, vec3 view_dir) {
+    // Stop at the reflection distance, or short of the near plane if the ray comes back towards the camera
+    float ray_length = u_reflection_distance;
+    if (view_dir.z > 0.0f) ray_length = min(ray_length, (-2.0f * u_cam_near - view_pos.z) / view_dir.z);
+
+    vec3 view_end = view_pos + view_dir * ray_length;
+    vec4 clip_start = u_proj_matrix * vec4(view_pos, 1.0f);
+    vec4 clip_end = u_proj_matrix * vec4(view_end, 1.0f);
+
+    // Window depth is linear in screen space, so the ray is stepped in uv and depth together
+    vec3 start = vec3(0.5f * clip_start.xy / clip_start.w + 0.5f, dot(u_refraction_depth, vec4(view_pos, 1.0f)) / clip_start.w);
+    vec3 end = vec3(0.5f * clip_end.xy / clip_end.w + 0.5f, dot(u_refraction_depth, vec4(view_end, 1.0f)) / clip_end.w);
+
+    vec2 texels = vec2(textureSize(u_sampler_depth0, 0));
+    vec3 delta = end - start;
+    float ray_texels = max(abs(delta.x) * texels.x, abs(delta.y) * texels.y);
+    if (ray_texels < 1.0f) return vec3(0.0f);
+
+    vec3 texel_step = delta / ray_texels;
+
+    float t = 1.0f;
+    int level = 0;
+
+    for (int i = 0 ; i < ssr_steps ; i += 1) {
+        float stride = exp2(float(level));
+        float next = t + stride;
+
+        if (next > ray_texels) {
+            if (level == 0) break;
+            level -= 1;
+            continue;
+        }
+
+        vec3 p = start + texel_step * next;
+        if (p.x < 0.0f || p.x > 1.0f || p.y < 0.0f || p.y > 1.0f) break;
+
+        // Level 0 is the full resolution depth; level n is the pyramid level covering 2^n texels
+        float scene_depth;
+        if (level == 0) {
+            scene_depth = texelFetch(u_sampler_depth0, ivec2(p.xy * texels), 0).x;
+        } else {
+            ivec2 last = textureSize(u_sampler_depth_pyramid, level - 1) - 1;
+            scene_depth = texelFetch(u_sampler_depth_pyramid, min(ivec2(p.xy * texels / stride), last), level - 1).x;
+        }
+
+        // With reversed-Z, the ray is behind the nearest surface in the cell when its depth is smaller
+        if (p.z < scene_depth) {
+            if (level > 0) {
+                level -= 1;
+                continue;
+            }
+
+            // The main view's depth row only has a w term, so w is found directly from depth
+            float thickness = u_refraction_depth.w / p.z - u_refraction_depth.w / scene_depth;
+
+            if (thickness < ssr_thickness) {
+                vec2 edge = min(p.xy, 1.0f - p.xy);
+                float confidence = clamp(min(edge.x, edge.y) / ssr_edge_fade, 0.0f, 1.0f);
+                confidence *= clamp(4.0f * (1.0f - next / ray_texels), 0.0f, 1.0f);
+                return vec3(p.xy, confidence);
+            }
+        }
+
+        t = next;
+        level = min(level + 1, u_depth_pyramid_levels);
+    }
+
+    return vec3(0.0f);
+}
+
+// Parallax correction; the reflected ray is followed to the probe's box, and the cubemap is looked up towards
+// where it leaves, rather than along the ray from the probe's centre
+vec3 probe_direction(reflection_probe probe, vec3 dir) {
+    vec3 safe_dir = mix(vec3(1e-5f), dir, greaterThan(abs(dir), vec3(1e-5f)));
+    vec3 t_exit = max((probe.box_max - v_world_pos) / safe_dir, (probe.box_min - v_world_pos) / safe_dir);
+    float t = min(min(t_exit.x, t_exit.y), t_exit.z);
+
+    // Outside the box there's nothing to correct against
+    if (t <= 0.0f) return dir;
+    return v_world_pos + dir * t - probe.position;
+}
+
+// Probes fade out towards their radius; whatever weight they leave over goes to the fallback
+vec4 sample_probes(vec3 dir, vec4 fallback) {
+    vec4 color = vec4(0.0f);
+    float total = 0.0f;
+
+    if (u_num_probes > 0) {
+        float weight = clamp(1.0f - length(v_world_pos - u_probes[0].position) / u_probes[0].radius, 0.0f, 1.0f);
+        color += weight * texture(u_sampler_probe0, probe_direction(u_probes[0], dir));
+        total += weight;
+    }
+
+    if (u_num_probes > 1) {
+        float weight = clamp(1.0f - length(v_world_pos - u_probes[1].position) / u_probes[1].radius, 0.0f, 1.0f);
+        color += weight * texture(u_sampler_probe1, probe_direction(u_probes[1], dir));
+        total += weight;
+    }
+
+    if (total > 1.0f) return color / total;
+    return color + fallback * (1.0f - total);
+}
+
 void main() {
     vec2 ndc = v_clip_pos.xy / v_clip_pos.w;
-    vec2 reflect_uv = 0.5f * vec2(ndc.x, -ndc.y) + 0.5f;
-    vec2 refract_uv = 0.5f * vec2(ndc.x, ndc.y) + 0.5f;
+    vec2 reflect_uv;
+    vec3 screen_space_hit;
+
+    if (u_reflection_mode == REFLECTION_SCREEN_SPACE) {
+        vec3 view_pos = (u_view_matrix * vec4(v_world_pos, 1.0f)).xyz;
+        vec3 view_normal = normalize(mat3(u_view_matrix) * vec3(0.0f, 1.0f, 0.0f));
+
+        screen_space_hit = trace_screen_space(view_pos, reflect(normalize(view_pos), view_normal));
+        reflect_uv = screen_space_hit.xy;
+    } else if (u_reflection_mode == REFLECTION_PLANAR) {
+        vec4 reflect_clip_pos = u_reflection_matrix * vec4(v_world_pos, 1.0f);
+        reflect_uv = 0.5f * reflect_clip_pos.xy / reflect_clip_pos.w + 0.5f;
+    } else {
+        reflect_uv = vec2(0.0f);
+    }
 
-    gl_FragDepth = log2(1.0f + v_w) * (2.0f / log2(u_cam_far + 1.0f) / log2(2.0f)) * 0.5f;
+    vec2 refract_uv = 0.5f * vec2(ndc.x, ndc.y) + 0.5f;
 
+    // Solve for the floor's view distance along this pixel's view ray; the thickness of water in front of it is
+    // scaled as the old logarithmic depth difference was
+    vec3 ray = vec3(ndc.x / u_proj_matrix[0][0], ndc.y / u_proj_matrix[1][1], -1.0f);
     float floor_depth = texture(u_sampler_depth0, refract_uv).x;
-    float water_depth = gl_FragDepth;
-    vec3 dist_to_cam = v_world_pos - u_camera_pos;
-    float depth = (floor_depth - water_depth) * length(dist_to_cam);
+    float floor_w = u_refraction_depth.w / max(floor_depth - dot(u_refraction_depth.xyz, ray), 1e-6f);
+    float depth = (floor_w - v_w) / log(u_cam_far + 1.0f);
     float alpha = clamp(7.5f * depth, 0.0f, 1.0f);
 
     float t = fract(u_time * time_factor);
+    vec2 undistorted_uv = refract_uv;
 
     float depth_distortion_strength = clamp(depth, 0.0f, 1.0f);
     vec4 dudv1 = texture(u_sampler_dudv, vec2(v_texcoord0.x + t, v_texcoord0.y));
@@ -85,7 +248,26 @@ void main() {
     reflect_uv = vec2(clamp(reflect_uv.x, 0.001f, 0.999f), clamp(reflect_uv.y, 0.001f, 0.999f));
     refract_uv = vec2(clamp(refract_uv.x, 0.001f, 0.999f), clamp(refract_uv.y, 0.001f, 0.999f));
 
-    vec4 reflect = texture(u_sampler_reflection, reflect_uv);
+    // The refraction is a copy of the whole view, so don't let the distortion pull in anything in front of the water
+    if (texture(u_sampler_depth0, refract_uv).x > gl_FragCoord.z) refract_uv = undistorted_uv;
+
+    // Probes are looked up along the reflected view ray, tilted by the same distortion as everything else
+    vec3 surface_normal = normalize(vec3(d1.x + d2.x, 1.0f, d1.y + d2.y));
+    vec3 reflect_dir = reflect(normalize(v_world_pos - u_camera_pos), surface_normal);
+
+    vec4 reflect;
+    if (u_reflection_mode == REFLECTION_PLANAR) {
+        reflect = texture(u_sampler_reflection, reflect_uv);
+    } else {
+        vec4 environment = sample_probes(reflect_dir, vec4(u_sky_color, 1.0f));
+
+        if (u_reflection_mode == REFLECTION_SCREEN_SPACE) {
+            reflect = mix(environment, texture(u_sampler_refraction, reflect_uv), screen_space_hit.z);
+        } else {
+            reflect = environment;
+        }
+    }
+
     vec4 refract = texture(u_sampler_refraction, refract_uv);
 
     vec4 nmap = texture(u_sampler_normal, v_texcoord0 + d1 + d2);
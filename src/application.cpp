@@ -1,6 +1,9 @@
 #include <iostream>
 #include <optional>
 #include <ostream>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
 #include <glm/ext/matrix_clip_space.hpp>
 
 #include "utilities.h"
@@ -10,7 +13,13 @@
 #include "camera.h"
 #include "serialise.h"
 #include "texture.h"
+#include "texture_streamer.h"
+#include "residency.h"
+#include "material_table.h"
 #include "renderer.h"
+#include "directional_light.h"
+#include "point_light.h"
+#include "reflection_probe.h"
 
 void application::create() {
     m_program_time_start = std::chrono::high_resolution_clock::now();
@@ -38,7 +47,7 @@ void application::create() {
     m_window_width = screen_width;
     m_window_height = screen_width * DEFAULT_ASPECT;
 
-    m_window = SDL_CreateWindow("Little Engine",
+    m_window = SDL_CreateWindow(WINDOW_TITLE,
                                 (screen_width - m_window_width) / 2, (screen_height - m_window_height) / 2,
                                 m_window_width, m_window_height, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_MAXIMIZED);
 
@@ -66,27 +75,89 @@ void application::create() {
     display_gl_version_info();
 #endif
 
+    // Programs are linked on the driver's threads where it can, and each is only waited for on its first use
+    gl_enable_parallel_shader_compile();
+
     // Set up pipeline
     m_lightpipeline.initialise({
             { GL_VERTEX_SHADER, "shaders/phong.vs" },
             { GL_FRAGMENT_SHADER, "shaders/phong.fs" }
-        }, STANDARD_PIPELINE);
+        }, STANDARD_PIPELINE, PIPELINE_LIGHTING_FEATURES);
     
     m_shadowpipeline.initialise({
             { GL_VERTEX_SHADER, "shaders/shadow.vs" },
             { GL_FRAGMENT_SHADER, "shaders/shadow.fs" }
         }, STANDARD_PIPELINE);
 
+    // Depth-only pre-pass for the forward path; draws the same geometry as the lighting pass
+    m_depthpipeline.initialise({
+            { GL_VERTEX_SHADER, "shaders/depth.vs" },
+            { GL_FRAGMENT_SHADER, "shaders/depth.fs" }
+        }, STANDARD_PIPELINE);
+
+    // Water reflections; the same geometry and shaders as the lighting pass, with cheaper shadows
+    m_reflectionpipeline.initialise({
+            { GL_VERTEX_SHADER, "shaders/phong.vs" },
+            { GL_FRAGMENT_SHADER, "shaders/phong.fs" }
+        }, STANDARD_PIPELINE, PIPELINE_LIGHTING_FEATURES | PIPELINE_FEATURE_REFLECTION);
+
+    // Screen-space water reflections trace through a pyramid of the main view's depth
+    m_depthpyramidpipeline.initialise({
+            { GL_VERTEX_SHADER, "shaders/deferred.vs" },
+            { GL_FRAGMENT_SHADER, "shaders/depth_pyramid.fs" }
+        }, DEFERRED_PIPELINE);
+
+    // Stretches the view over the window when it's drawn at a lower resolution
+    m_upscalepipeline.initialise({
+            { GL_VERTEX_SHADER, "shaders/upscale.vs" },
+            { GL_FRAGMENT_SHADER, "shaders/upscale.fs" }
+        }, DEFERRED_PIPELINE);
+
+    // Deferred path; the G-buffer pass draws the same geometry as the forward lighting pass
+    m_gbufferpipeline.initialise({
+            { GL_VERTEX_SHADER, "shaders/phong.vs" },
+            { GL_FRAGMENT_SHADER, "shaders/gbuffer.fs" }
+        }, STANDARD_PIPELINE, PIPELINE_FEATURE_SPECULAR_MAP);
+
+    m_deferredpipeline.initialise({
+            { GL_VERTEX_SHADER, "shaders/deferred.vs" },
+            { GL_FRAGMENT_SHADER, "shaders/deferred.fs" }
+        }, DEFERRED_PIPELINE, PIPELINE_FEATURE_SHADOWS | PIPELINE_FEATURE_POINT_LIGHTS | PIPELINE_FEATURE_PCF_MASK);
+
     // Set up pipeline
     m_waterpipeline.initialise({
             { GL_VERTEX_SHADER, "shaders/water.vs" },
             { GL_FRAGMENT_SHADER, "shaders/water.fs" }
         }, WATER_PIPELINE);
 
+    // Start the variants the first frames are likely to use, so that they compile alongside everything else;
+    // the camera's default shadow filter is assumed
+    unsigned int lit = PIPELINE_FEATURE_SHADOWS | PIPELINE_FEATURE_POINT_LIGHTS | PIPELINE_FEATURE_PCF(SHADOW_QUALITY_GAUSSIAN);
+
+    for (unsigned int specular : { 0u, PIPELINE_FEATURE_SPECULAR_MAP }) {
+        m_lightpipeline.prepare(lit | specular);
+        m_reflectionpipeline.prepare(lit | specular | PIPELINE_FEATURE_REFLECTION);
+        m_gbufferpipeline.prepare(specular);
+    }
+
+    m_deferredpipeline.prepare(lit);
+
     // Set up FBOs
-    m_shadowmap.initialise(DEFAULT_SHADOW_MAP_WIDTH, DEFAULT_SHADOW_MAP_HEIGHT, true, false, true);
-    m_refractionmap.initialise(DEFAULT_REFRACTION_MAP_WIDTH, DEFAULT_REFRACTION_MAP_HEIGHT, true, true, true);
-    m_reflectionmap.initialise(DEFAULT_REFLECTION_MAP_WIDTH, DEFAULT_REFLECTION_MAP_HEIGHT, false, true, false);
+
+    // Light clusters
+    m_clusters.initialise();
+    m_reflection_clusters.initialise();
+
+    // Full screen passes generate their vertices from gl_VertexID, but still need a vertex array bound
+    glGenVertexArrays(1, &m_empty_vao);
+
+#ifndef __EMSCRIPTEN__
+    glGenQueries(OVERDRAW_QUERIES, m_overdraw_queries);
+#endif
+
+    m_profiler.initialise();
+
+    register_passes();
     
     // Textures
     m_noise_texture = new texture(GL_TEXTURE_2D, "assets/noise.png");
@@ -151,8 +222,20 @@ std::optional<error> application::load_scene(std::string filename) {
     option<scene*, error> res = serial::read_scene_from_file(filename);
     if (std::holds_alternative<error>(res)) return std::get<error>(res);
 
+    // Probe cubemaps belong to the previous scene's components
+    if (m_scene) {
+        for (reflection_probe* probe : m_scene->get_reflection_probes()) probe->destroy();
+    }
+
     m_scene = std::get<scene*>(res);
     m_scene->load(this);
+
+    // Cached shadows and reflections belong to the previous scene
+    m_shadow_casters.clear();
+    m_static_casters_revision += 1;
+
+    for (water_plane& plane : m_water_planes) plane.destroy();
+    m_water_planes.clear();
     return std::nullopt;
 }
 
@@ -183,105 +266,597 @@ void application::render() {
 
     camera* cam = res.value();
 
-    // Get references to the scene's lights
-    std::vector<directional_light*> d_lights = m_scene->get_directional_lights();
-    std::vector<point_light*> p_lights = m_scene->get_point_lights();
+    m_profiler.set_log(cam->m_profiler_log);
+    m_profiler.begin_frame(m_frame);
 
-    // View & projection matrices for camera & lights
-    glm::mat4 view_mat { cam->get_view_matrix() };
-    glm::mat4 proj_mat { cam->get_perspective_matrix() };
-    glm::mat4 shadow_mat {};
+    // Textures still loading get a few more of their mips
+    m_profiler.begin_pass("texture uploads");
+    texture_stream().update(TEXTURE_UPLOAD_BUDGET);
 
-    for (directional_light* d : d_lights) {
-        if (d->shadow_caster) {
-            shadow_mat = d->get_shadow_matrix(cam, view_mat);
-            break;
+    // Materials whose textures have moved into an array, or sharpened, this frame
+    shared_materials().update();
+    shared_materials().bind(MATERIAL_TABLE_TEX_UNIT);
+    m_profiler.end_pass();
+
+    // The scene's lights, and the view & projection matrices for camera & lights; kept for the registered passes too
+    m_frame_state.cam = cam;
+    m_frame_state.d_lights = m_scene->get_directional_lights();
+    m_frame_state.p_lights = m_scene->get_point_lights();
+    m_frame_state.view_mat = cam->get_view_matrix();
+    m_frame_state.proj_mat = cam->get_perspective_matrix();
+
+    std::vector<directional_light*>& d_lights = m_frame_state.d_lights;
+    std::vector<point_light*>& p_lights = m_frame_state.p_lights;
+    glm::mat4& view_mat = m_frame_state.view_mat;
+    glm::mat4& proj_mat = m_frame_state.proj_mat;
+
+    // Resolution for this frame, from the GPU time of the last few
+    m_resolution.update(m_profiler.last_frame_gpu_ms(), m_profiler.last_frame(), cam->m_frame_time_target, cam->m_min_resolution_scale);
+    m_render_width = glm::max(static_cast<int>(width() * m_resolution.scale()), 1);
+    m_render_height = glm::max(static_cast<int>(height() * m_resolution.scale()), 1);
+
+    // Drop or restore texture mips to fit the memory budget
+    update_residency(cam, view_mat, proj_mat);
+
+    // Bin the point lights into clusters
+    m_clusters.build(p_lights, view_mat, proj_mat, cam->m_near, cam->m_far);
+
+    // Which water can be seen is decided up front, so that the passes for water out of sight aren't added at all
+    gather_water_planes();
+
+    std::vector<water_plane*> visible_water {};
+    bool water_in_frustum = false;
+
+    for (water_plane& plane : m_water_planes) {
+        bool visible = water_visible(plane, view_mat, proj_mat);
+        water_in_frustum = water_in_frustum || !plane.in_frustum.empty();
+
+        if (!visible) continue;
+
+        plane.distance = std::numeric_limits<float>::max();
+        for (scene_node* n : plane.bodies) {
+            plane.distance = glm::min(plane.distance, static_cast<renderer*>(n->component)->world_bounds().distance(cam->position()));
         }
+
+        visible_water.push_back(&plane);
     }
 
-    // Shadow pass
-    render_shadows(cam, d_lights, p_lights, shadow_mat);
+    std::sort(visible_water.begin(), visible_water.end(), [](water_plane* a, water_plane* b) { return a->distance < b->distance; });
+
+    bool screen_space = cam->m_water_reflection == WATER_REFLECTION_SCREEN_SPACE;
+    bool planar = !screen_space && cam->m_water_reflection != WATER_REFLECTION_PROBE;
+
+    if (!planar) {
+        for (water_plane& plane : m_water_planes) {
+            plane.reflection_map.destroy();
+            plane.reflection_valid = false;
+        }
+    }
+
+    // The frame's targets, with screen sized ones at the scaled resolution; shadow maps, probes and water reflections persist between frames, so are only imported
+    render_target_desc view_desc { { GL_RGBA8 }, GL_DEPTH_COMPONENT32F };
+    render_target_desc gbuffer_desc { { GL_RGBA8, GL_RGBA8, GL_RGBA8, GL_RGB10_A2 }, GL_DEPTH_COMPONENT32F };
+
+    m_graph.clear();
+
+    render_graph::resource shadow_maps = m_graph.import_resource("shadow maps");
+    render_graph::resource probes = m_graph.import_resource("reflection probes");
+    render_graph::resource reflections = m_graph.import_resource("water reflections");
+
+    render_graph::resource main_view = m_graph.create_target("main view", view_desc);
+    render_graph::resource gbuffer = m_graph.create_target("gbuffer", gbuffer_desc);
+    render_graph::resource refraction = m_graph.create_target("refraction", view_desc);
+
+    // Shadow pass; this also fits each cascade's matrix around the casters that are drawn
+    m_graph.add_pass("shadows", {}, { shadow_maps }, [&]() {
+        use_reversed_depth(false);
+        render_shadows(cam, d_lights, p_lights, view_mat);
+        use_reversed_depth(true);
+    });
+
+    m_graph.declare_stage(RENDER_STAGE_BEFORE_LIGHTING);
 
     // Lighting pass
-    render_lighting(cam, d_lights, p_lights, view_mat, proj_mat, shadow_mat);
+    if (cam->m_render_path == RENDER_PATH_DEFERRED) {
+        m_graph.add_pass("gbuffer", {}, { gbuffer }, [&]() {
+            render_gbuffer(view_mat, proj_mat, m_graph.target(gbuffer));
+        });
+
+        m_graph.add_pass("deferred lighting", { gbuffer, shadow_maps }, { main_view }, [&]() {
+            render_deferred(cam, d_lights, m_clusters, view_mat, proj_mat, m_graph.target(gbuffer), m_graph.target(main_view));
+        });
+    } else {
+        m_graph.add_pass("forward lighting", { shadow_maps }, { main_view }, [&]() {
+            render_lighting(cam, d_lights, m_clusters, view_mat, proj_mat, m_graph.target(main_view));
+        });
+    }
 
-    // Water pass
-    std::optional<renderer*> water = m_scene->get_water_renderer();
-    if (water.has_value()) render_water(cam, d_lights, p_lights, view_mat, proj_mat, shadow_mat, water.value());
-}
+    // Water in the frustum is tested against the opaque scene, for next frame's decision
+    if (water_in_frustum) {
+        m_graph.add_pass("water occlusion", { main_view }, {}, [&]() {
+            for (water_plane& plane : m_water_planes) query_water_occlusion(plane, view_mat, proj_mat, m_graph.target(main_view));
+        }, true);
+    }
 
-void application::render_lighting(camera* cam, std::vector<directional_light*>& d_lights, std::vector<point_light*>& p_lights,
-                                    glm::mat4& view_mat, glm::mat4& proj_mat, glm::mat4& shadow_mat, bool external_setup) {
+    // Water pass; of its reflection sources, only the one the camera uses is read, so the others' passes are culled
+    if (!visible_water.empty()) {
+        m_graph.add_pass("water reflections", { shadow_maps }, { reflections }, [&]() {
+            render_water_reflections(cam, d_lights, p_lights, proj_mat, visible_water);
+        });
 
-    // Skybox colour
+        // Refraction; everything under the water is already in the main view, so that's copied rather than redrawn
+        m_graph.add_pass("refraction", { main_view }, { refraction }, [&]() {
+            m_graph.target(main_view).blit(m_graph.target(refraction), GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        });
+    }
+
+    m_graph.declare_stage(RENDER_STAGE_BEFORE_WATER);
+
+    if (!visible_water.empty()) {
+        // The depth pyramid's pass is registered with the graph, and is culled unless screen-space reflections read it
+        render_graph::resource depth_pyramid = m_graph.find("depth pyramid");
+        bool traced = screen_space && depth_pyramid >= 0;
+
+        std::vector<render_graph::resource> water_reads { main_view, refraction, planar ? reflections : probes };
+        if (traced) water_reads.push_back(depth_pyramid);
+
+        m_graph.add_pass("water", water_reads, { main_view }, [&, depth_pyramid, traced]() {
+            render_water(cam, d_lights, view_mat, proj_mat, visible_water, m_graph.target(main_view), m_graph.target(refraction),
+                         traced ? &m_graph.target(depth_pyramid) : nullptr);
+        });
+    }
+
+    m_graph.declare_stage(RENDER_STAGE_BEFORE_PRESENT);
+
+    m_graph.add_pass("present", { main_view }, {}, [&]() {
+        present(cam, m_graph.target(main_view));
+    }, true);
+
+    m_graph.execute(m_render_width, m_render_height, &m_profiler);
+
+    m_profiler.end_frame();
+    update_profiler_overlay(cam);
+
+    m_frame += 1;
+}
+
+glm::vec3 application::sky_colour() {
     glm::vec3 night { 0.2, 0.2, 0.4 };
     glm::vec3 day { 0.4, 0.4, 0.75 };
-    glm::vec3 now = day + (night - day) * (-sin(time()) * 0.5f + 0.5f);
+    return day + (night - day) * (-sin(time()) * 0.5f + 0.5f);
+}
 
-    
-    if (external_setup == false) {
-        m_lightpipeline.enable();
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0, 0, width(), height());
-    }
+void application::use_reversed_depth(bool reversed) {
+    // Without clip control, the projection matrix remaps depth instead; see camera::get_perspective_matrix
+    if (gl_has_clip_control()) glClipControl(GL_LOWER_LEFT, reversed ? GL_ZERO_TO_ONE : GL_NEGATIVE_ONE_TO_ONE);
 
-    // Enable shadow texture
-    m_shadowmap.bind_depth_for_reading(DEPTH_TEX_UNIT0);
+    glClearDepthf(reversed ? 0.0f : 1.0f);
+    glDepthFunc(reversed ? GL_GREATER : GL_LESS);
+}
+
+unsigned int application::lighting_features(camera* cam, light_clusters& clusters) {
+    unsigned int features = PIPELINE_FEATURE_PCF(glm::clamp(cam->m_shadow_quality, SHADOW_QUALITY_BILINEAR, SHADOW_QUALITY_POISSON));
+
+    if (!m_cascade_splits.empty()) features |= PIPELINE_FEATURE_SHADOWS;
+    if (clusters.num_lights() > 0) features |= PIPELINE_FEATURE_POINT_LIGHTS;
+
+    return features;
+}
+
+void application::set_lighting_uniforms(pipeline& p, camera* cam, std::vector<directional_light*>& d_lights, light_clusters& clusters,
+                                    glm::mat4& view_mat, glm::mat4& proj_mat) {
+
+    // Enable shadow texture; the static maps can be used directly when nothing in them has moved
+    if (m_shadow_dynamic) m_shadowmap.bind_depth_for_reading(SHADOW_TEX_UNIT);
+    else m_static_shadowmap.bind_depth_for_reading(SHADOW_TEX_UNIT);
 
     // Enable noise texture
     m_noise_texture->bind(NOISE_TEX_UNIT);
 
+    // Enable point light clusters
+    clusters.bind(LIGHTS_TEX_UNIT, CLUSTERS_TEX_UNIT, LIGHT_INDICES_TEX_UNIT);
+
+    p.set_uniform(pipeline::UNIFORM_SAMPLER_SHADOW, SHADOW_TEX_UNIT_INDEX);
+    p.set_uniform(pipeline::UNIFORM_SAMPLER_NOISE, NOISE_TEX_UNIT_INDEX);
+    p.set_uniform(pipeline::UNIFORM_SAMPLER_LIGHTS, LIGHTS_TEX_UNIT_INDEX);
+    p.set_uniform(pipeline::UNIFORM_SAMPLER_CLUSTERS, CLUSTERS_TEX_UNIT_INDEX);
+    p.set_uniform(pipeline::UNIFORM_SAMPLER_LIGHT_INDICES, LIGHT_INDICES_TEX_UNIT_INDEX);
+    
+    // Camera uniforms
+    p.set_uniform(pipeline::UNIFORM_VIEW_MAT, view_mat);
+    p.set_uniform(pipeline::UNIFORM_PROJ_MAT, proj_mat);
+
+    // Shadow cascades
+    p.set_uniform(pipeline::UNIFORM_NUM_CASCADES, static_cast<int>(m_cascade_splits.size()));
+    p.set_uniform(pipeline::UNIFORM_SHADOW_MATS, m_cascade_matrices);
+    p.set_uniform(pipeline::UNIFORM_CASCADE_SPLITS, m_cascade_splits);
+    p.set_uniform(pipeline::UNIFORM_SHADOW_TEXEL_SIZE, 1.0f / m_static_shadowmap.m_pixel_width);
+
+    p.set_uniform(pipeline::UNIFORM_CAMERA_POS, cam->position());
+    p.set_uniform(pipeline::UNIFORM_CAMERA_NEAR, cam->m_near);
+
+    // Miscellaneous
+    p.set_uniform(pipeline::UNIFORM_TIME, time());
+    
+    // Set light uniforms
+    p.set_uniform(pipeline::UNIFORM_DIR_LIGHTS, d_lights);
+    p.set_uniform(pipeline::UNIFORM_CLUSTER_DEPTH, clusters.depth_params());
+}
+
+bool application::use_depth_prepass(camera* cam) {
+    if (cam->m_depth_prepass == DEPTH_PREPASS_ON) return true;
+    if (cam->m_depth_prepass != DEPTH_PREPASS_AUTO) return false;
+
+#ifdef __EMSCRIPTEN__
+    return false;
+#else
+    // Collect whichever measurements have arrived, without waiting for the rest
+    int pixels = m_render_width * m_render_height;
+
+    for (int i = 0 ; i < OVERDRAW_QUERIES ; i += 1) {
+        if (!m_overdraw_query_pending[i]) continue;
+
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(m_overdraw_queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available == GL_FALSE) continue;
+
+        GLuint samples = 0;
+        glGetQueryObjectuiv(m_overdraw_queries[i], GL_QUERY_RESULT, &samples);
+        m_overdraw_query_pending[i] = false;
+
+        if (pixels > 0) m_overdraw = static_cast<float>(samples) / pixels;
+    }
+
+    // Hysteresis keeps the mode from flickering when the overdraw sits near a threshold
+    if (m_depth_prepass_active && m_overdraw < DEPTH_PREPASS_DISABLE_OVERDRAW) m_depth_prepass_active = false;
+    else if (!m_depth_prepass_active && m_overdraw > DEPTH_PREPASS_ENABLE_OVERDRAW) m_depth_prepass_active = true;
+
+    return m_depth_prepass_active;
+#endif
+}
+
+bool application::begin_overdraw_query() {
+#ifdef __EMSCRIPTEN__
+    return false;
+#else
+    // Skip the measurement if the oldest query still hasn't been read back
+    int index = m_overdraw_query_index;
+    if (m_overdraw_query_pending[index]) return false;
+
+    glBeginQuery(GL_SAMPLES_PASSED, m_overdraw_queries[index]);
+    m_overdraw_query_pending[index] = true;
+    m_overdraw_query_index = (index + 1) % OVERDRAW_QUERIES;
+
+    return true;
+#endif
+}
+
+void application::render_lighting(camera* cam, std::vector<directional_light*>& d_lights, light_clusters& clusters,
+                                    glm::mat4& view_mat, glm::mat4& proj_mat, fbo& target) {
+
+    // Skybox colour
+    glm::vec3 now = sky_colour();
+
+    bool prepass = use_depth_prepass(cam);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    target.bind_for_writing();
+
     glClearColor(now.r, now.g, now.b, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     glEnable(GL_DEPTH_TEST);
     glCullFace(GL_BACK);
+
+    // Overdraw is counted in whichever pass lays down depth first; the fragments passing the depth test there are
+    // the ones the lighting pass would shade without a pre-pass
+    bool measuring = cam->m_depth_prepass == DEPTH_PREPASS_AUTO && begin_overdraw_query();
+
+    if (prepass) {
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+        m_depthpipeline.enable();
+        m_depthpipeline.set_uniform(pipeline::UNIFORM_VIEW_MAT, view_mat);
+        m_depthpipeline.set_uniform(pipeline::UNIFORM_PROJ_MAT, proj_mat);
+
+        m_scene->render(this, &m_depthpipeline);
+
+#ifndef __EMSCRIPTEN__
+        if (measuring) glEndQuery(GL_SAMPLES_PASSED);
+#endif
+
+        // Only the nearest fragment of each pixel now passes, and the depth buffer is already complete
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_GEQUAL);
+    }
+
+    m_lightpipeline.enable(lighting_features(cam, clusters));
     
     m_lightpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_DIFFUSE, DIFFUSE_TEX_UNIT_INDEX);
     m_lightpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_SPECULAR, SPECULAR_TEX_UNIT_INDEX);
-    m_lightpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_DEPTH0, DEPTH_TEX_UNIT0_INDEX);
-    m_lightpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_NOISE, NOISE_TEX_UNIT_INDEX);
-    
-    // Camera uniforms
-    m_lightpipeline.set_uniform(pipeline::UNIFORM_VIEW_MAT, view_mat);
-    m_lightpipeline.set_uniform(pipeline::UNIFORM_PROJ_MAT, proj_mat);
-    m_lightpipeline.set_uniform(pipeline::UNIFORM_SHADOW0_MAT, shadow_mat);
-
-    m_lightpipeline.set_uniform(pipeline::UNIFORM_CAMERA_POS, cam->position());
-    m_lightpipeline.set_uniform(pipeline::UNIFORM_CAMERA_FAR, cam->m_far);
+    m_lightpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_MATERIALS, MATERIAL_TABLE_TEX_UNIT_INDEX);
 
-    // Miscellaneous
-    m_lightpipeline.set_uniform(pipeline::UNIFORM_TIME, time());
-    
-    // Set light uniforms
-    m_lightpipeline.set_uniform(pipeline::UNIFORM_DIR_LIGHTS, d_lights);
-    m_lightpipeline.set_uniform(pipeline::UNIFORM_POINT_LIGHTS, p_lights);
+    set_lighting_uniforms(m_lightpipeline, cam, d_lights, clusters, view_mat, proj_mat);
     
     // Tell scene elements to recursively render themselves
     m_scene->render(this, &m_lightpipeline);
 
-    if (external_setup == false) {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glBindTexture(GL_TEXTURE_2D, 0);
+    if (prepass) {
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_GREATER);
     }
+#ifndef __EMSCRIPTEN__
+    else if (measuring) glEndQuery(GL_SAMPLES_PASSED);
+#endif
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    gl_error_check_barrier
+}
+
+void application::render_gbuffer(glm::mat4& view_mat, glm::mat4& proj_mat, fbo& gbuffer) {
+
+    // Geometry pass; only surface attributes are written, so overdraw costs no lighting
+    gbuffer.bind_for_writing();
+
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glEnable(GL_DEPTH_TEST);
+    glCullFace(GL_BACK);
+
+    m_gbufferpipeline.enable();
+
+    m_gbufferpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_DIFFUSE, DIFFUSE_TEX_UNIT_INDEX);
+    m_gbufferpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_SPECULAR, SPECULAR_TEX_UNIT_INDEX);
+    m_gbufferpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_MATERIALS, MATERIAL_TABLE_TEX_UNIT_INDEX);
+    m_gbufferpipeline.set_uniform(pipeline::UNIFORM_VIEW_MAT, view_mat);
+    m_gbufferpipeline.set_uniform(pipeline::UNIFORM_PROJ_MAT, proj_mat);
+
+    m_scene->render(this, &m_gbufferpipeline);
+
+    gl_error_check_barrier
+}
+
+void application::render_deferred(camera* cam, std::vector<directional_light*>& d_lights, light_clusters& clusters,
+                                    glm::mat4& view_mat, glm::mat4& proj_mat, fbo& gbuffer, fbo& target) {
+
+    // Lighting pass; one full screen triangle, over a copy of the G-buffer depth for the water pass to test against
+    glm::vec3 now = sky_colour();
+
+    gbuffer.blit(target, GL_DEPTH_BUFFER_BIT);
+
+    glClearColor(now.r, now.g, now.b, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glDisable(GL_DEPTH_TEST);
+
+    m_deferredpipeline.enable(lighting_features(cam, clusters));
+
+    gbuffer.bind_target_for_reading(0, GBUFFER_AMBIENT_TEX_UNIT);
+    gbuffer.bind_target_for_reading(1, GBUFFER_DIFFUSE_TEX_UNIT);
+    gbuffer.bind_target_for_reading(2, GBUFFER_SPECULAR_TEX_UNIT);
+    gbuffer.bind_target_for_reading(3, GBUFFER_NORMAL_TEX_UNIT);
+    gbuffer.bind_depth_for_reading(DEPTH_TEX_UNIT0);
+
+    m_deferredpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_GBUFFER_AMBIENT, GBUFFER_AMBIENT_TEX_UNIT_INDEX);
+    m_deferredpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_GBUFFER_DIFFUSE, GBUFFER_DIFFUSE_TEX_UNIT_INDEX);
+    m_deferredpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_GBUFFER_SPECULAR, GBUFFER_SPECULAR_TEX_UNIT_INDEX);
+    m_deferredpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_GBUFFER_NORMAL, GBUFFER_NORMAL_TEX_UNIT_INDEX);
+    m_deferredpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_DEPTH0, DEPTH_TEX_UNIT0_INDEX);
+
+    glm::mat4 inv_view_mat { glm::inverse(view_mat) };
+    m_deferredpipeline.set_uniform(pipeline::UNIFORM_INV_VIEW_MAT, inv_view_mat);
+
+    set_lighting_uniforms(m_deferredpipeline, cam, d_lights, clusters, view_mat, proj_mat);
+
+    glBindVertexArray(m_empty_vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    glEnable(GL_DEPTH_TEST);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
 
     gl_error_check_barrier
 }
 
+void application::classify_shadow_casters(std::vector<scene_node*>& renderers) {
+    int static_count = 0;
+
+    for (scene_node* n : renderers) {
+        renderer* r = static_cast<renderer*>(n->component);
+        if (r->m_pipeline != m_shadowpipeline.identifier()) continue;
+
+        // Components write their transforms directly, so a move is only seen in the model matrix
+        glm::mat4 model_mat = r->m_transform.get_model_matrix();
+
+        auto it = m_shadow_casters.find(n);
+        if (it == m_shadow_casters.end()) {
+            // New casters start out static
+            shadow_caster_state state {};
+            state.model_mat = model_mat;
+            state.moved_frame = m_frame - SHADOW_STATIC_FRAMES;
+
+            it = m_shadow_casters.emplace(n, state).first;
+            m_static_casters_revision += 1;
+        }
+
+        shadow_caster_state& state = it->second;
+
+        if (state.model_mat != model_mat) {
+            state.model_mat = model_mat;
+            state.moved_frame = m_frame;
+        }
+
+        // Casters move between the layers when they start moving, and once they've been still for a while
+        bool dynamic = m_frame - state.moved_frame < SHADOW_STATIC_FRAMES;
+        if (dynamic != state.dynamic) m_static_casters_revision += 1;
+        state.dynamic = dynamic;
+
+        if (!dynamic) static_count += 1;
+    }
+
+    // Catch casters leaving the scene
+    if (static_count != m_static_caster_count) m_static_casters_revision += 1;
+    m_static_caster_count = static_count;
+}
+
 void application::render_shadows(camera* cam, std::vector<directional_light*>& d_lights, std::vector<point_light*>& p_lights,
-                                    glm::mat4& shadow_mat) {
-    
-    m_shadowmap.bind_for_writing();
+                                    glm::mat4& view_mat) {
+
+    directional_light* caster_light { nullptr };
+
+    for (directional_light* d : d_lights) {
+        if (d->shadow_caster) {
+            caster_light = d;
+            break;
+        }
+    }
+
+    int num_cascades = glm::clamp(cam->m_shadow_cascades, 1, MAX_SHADOW_CASCADES);
+    int interval = glm::max(cam->m_shadow_cascade_interval, 1);
+
+    // The cascade count can be changed at run time, so the texture arrays are (re)created here
+    if (m_static_shadowmap.m_layers != num_cascades || m_static_shadowmap.m_depth_target != GL_TEXTURE_2D_ARRAY) {
+        m_static_shadowmap.destroy();
+        m_shadowmap.destroy();
+        m_static_shadowmap.initialise_layered(DEFAULT_SHADOW_MAP_WIDTH, DEFAULT_SHADOW_MAP_HEIGHT, num_cascades);
+
+        m_cascade_matrices.assign(num_cascades, glm::mat4 { 1.0f });
+        m_cascade_valid.assign(num_cascades, false);
+        m_cascade_static_revision.assign(num_cascades, 0);
+        m_cascade_dynamic.assign(num_cascades, false);
+        m_cascade_composited.assign(num_cascades, false);
+    }
+
+    // Practical split scheme; a blend of logarithmic and uniform splits between the near plane and the shadow range
+    float near = cam->m_near;
+    float far = glm::max(cam->m_shadow_range, near);
+    float lambda = glm::clamp(cam->m_shadow_split_lambda, 0.0f, 1.0f);
+
+    m_cascade_splits.resize(num_cascades);
+
+    for (int i = 0 ; i < num_cascades ; i += 1) {
+        float p = (i + 1) / static_cast<float>(num_cascades);
+        float log_split = near * glm::pow(far / near, p);
+        float uniform_split = near + (far - near) * p;
+        m_cascade_splits[i] = lambda * log_split + (1.0f - lambda) * uniform_split;
+    }
+
+    if (caster_light == nullptr) {
+        m_cascade_splits.clear();
+        m_shadow_dynamic = false;
+        return;
+    }
+
+    // Cascades drawn in earlier frames are no use once the light has turned
+    if (caster_light->revision != m_cascade_light_revision) {
+        m_cascade_light_revision = caster_light->revision;
+        m_cascade_valid.assign(num_cascades, false);
+    }
+
+    std::vector<scene_node*> renderers {};
+    m_scene->root->get_renderers(renderers);
+
+    classify_shadow_casters(renderers);
+
     glEnable(GL_DEPTH_TEST);
-    glClear(GL_DEPTH_BUFFER_BIT);
     glCullFace(GL_FRONT);
 
     m_shadowpipeline.enable();
 
-    m_shadowpipeline.set_uniform(pipeline::UNIFORM_SHADOW0_MAT, shadow_mat);
+    for (int i = 0 ; i < num_cascades ; i += 1) {
+
+        // The first cascade covers the most screen, so is redrawn every frame; the others take turns,
+        // unless a static caster has changed
+        bool due = i == 0 || (m_frame + i) % interval == 0;
+        bool static_changed = m_cascade_static_revision[i] != m_static_casters_revision;
+        if (m_cascade_valid[i] && !due && !static_changed) continue;
+
+        // Each cascade also covers the blend band at the far end of the previous one
+        float slice_near = near;
+        if (i > 0) {
+            float previous_near = i > 1 ? m_cascade_splits[i - 2] : near;
+            slice_near = m_cascade_splits[i - 1] - (m_cascade_splits[i - 1] - previous_near) * SHADOW_CASCADE_BLEND_BAND;
+        }
+
+        shadow_volume volume { caster_light->get_shadow_volume(cam, view_mat, slice_near, m_cascade_splits[i], m_static_shadowmap.m_pixel_width) };
+
+        // Only draw casters that can throw a shadow into this cascade, and are big enough to show up in it
+        std::vector<scene_node*> static_casters {};
+        std::vector<scene_node*> dynamic_casters {};
+
+        for (scene_node* n : renderers) {
+            renderer* r = static_cast<renderer*>(n->component);
+            if (r->m_pipeline != m_shadowpipeline.identifier()) continue;
+
+            aabb caster_bounds { r->world_bounds().transformed(volume.light_view) };
+
+            if (!volume.reaches(caster_bounds)) continue;
+            if (!volume.resolvable(caster_bounds, m_static_shadowmap.m_pixel_width)) continue;
+
+            // Only static casters are allowed to move the near plane, otherwise anything moving would
+            // change the projection and throw the cache away; shadow.vs clamps the rest onto the near plane
+            if (m_shadow_casters[n].dynamic) {
+                dynamic_casters.push_back(n);
+            } else {
+                volume.extend_toward_light(caster_bounds);
+                static_casters.push_back(n);
+            }
+        }
+
+        glm::mat4 matrix { volume.get_matrix() };
+
+        if (!m_cascade_valid[i] || static_changed || matrix != m_cascade_matrices[i]) {
+            m_cascade_matrices[i] = matrix;
+            m_cascade_static_revision[i] = m_static_casters_revision;
+            m_cascade_composited[i] = false;
+
+            m_static_shadowmap.bind_layer_for_writing(i);
+            glClear(GL_DEPTH_BUFFER_BIT);
 
-    m_scene->render(this, &m_shadowpipeline);
+            m_shadowpipeline.set_uniform(pipeline::UNIFORM_SHADOW0_MAT, m_cascade_matrices[i]);
+
+            for (scene_node* n : static_casters) n->cmp_render(this, m_scene, n, &m_shadowpipeline);
+        }
+
+        m_cascade_valid[i] = true;
+
+        // Moving casters are drawn over a copy of the static depth, which keeps the nearer of the two
+        if (!dynamic_casters.empty()) {
+            if (m_shadowmap.m_fbo == 0) {
+                m_shadowmap.initialise_layered(DEFAULT_SHADOW_MAP_WIDTH, DEFAULT_SHADOW_MAP_HEIGHT, num_cascades);
+            }
+
+            m_static_shadowmap.blit_layer_depth(m_shadowmap, i);
+
+            m_shadowpipeline.set_uniform(pipeline::UNIFORM_SHADOW0_MAT, m_cascade_matrices[i]);
+
+            for (scene_node* n : dynamic_casters) n->cmp_render(this, m_scene, n, &m_shadowpipeline);
+
+            m_cascade_composited[i] = true;
+        } else if (m_cascade_dynamic[i]) {
+            m_cascade_composited[i] = false;
+        }
+
+        m_cascade_dynamic[i] = !dynamic_casters.empty();
+    }
+
+    // If anything is moving, the lighting pass reads the composited maps, so every layer of them has to be current
+    m_shadow_dynamic = false;
+    for (int i = 0 ; i < num_cascades ; i += 1) m_shadow_dynamic = m_shadow_dynamic || m_cascade_dynamic[i];
+
+    if (m_shadow_dynamic) {
+        for (int i = 0 ; i < num_cascades ; i += 1) {
+            if (m_cascade_composited[i]) continue;
+
+            m_static_shadowmap.blit_layer_depth(m_shadowmap, i);
+            m_cascade_composited[i] = true;
+        }
+    }
 
     glBindTexture(GL_TEXTURE_2D, 0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -289,53 +864,412 @@ void application::render_shadows(camera* cam, std::vector<directional_light*>& d
     gl_error_check_barrier
 }
 
-void application::render_water(camera* cam, std::vector<directional_light*>& d_lights, std::vector<point_light*>& p_lights,
-                                    glm::mat4& view_mat, glm::mat4& proj_mat, glm::mat4& shadow_mat, renderer* water) {
+void application::gather_water_planes() {
+    std::vector<scene_node*> bodies { m_scene->get_water_renderers() };
 
-    // Need smaller light passes before main water pass
-    m_lightpipeline.enable();
-    m_lightpipeline.set_uniform(pipeline::UNIFORM_CLIP_ENABLED, 1.0f);
-    
-    // Reflection pass
-    m_reflectionmap.bind_for_writing();
-    
-    glm::vec4 reflect_normal { 0, 1, 0, -(water->m_transform.pos.y) };
-    m_lightpipeline.set_uniform(pipeline::UNIFORM_CLIP_PLANE, reflect_normal);
-
-    float d = 2 * (cam->m_pos.y - water->m_transform.pos.y);
-    cam->m_pos.y -= d;
-    float pitch = cam->m_mouse.y;
-    cam->rotate({0, -2 * pitch}, false);
-    glm::mat4 reflect_view { cam->get_view_matrix() };
-    
-    render_lighting(cam, d_lights, p_lights, reflect_view, proj_mat, shadow_mat, true);
-    cam->m_pos.y += d;
-    cam->rotate({0, 2 * pitch}, false);
+    for (water_plane& plane : m_water_planes) plane.bodies.clear();
+
+    // Planes persist between frames, so that their reflections and queries carry over
+    for (scene_node* n : bodies) {
+        float height = static_cast<renderer*>(n->component)->m_transform.pos.y;
+
+        auto it = std::find_if(m_water_planes.begin(), m_water_planes.end(),
+                               [height](const water_plane& p) { return glm::abs(p.height - height) <= WATER_PLANE_TOLERANCE; });
+
+        if (it == m_water_planes.end()) {
+            water_plane plane {};
+            plane.height = height;
+            glGenQueries(1, &plane.query);
+
+            m_water_planes.push_back(plane);
+            it = m_water_planes.end() - 1;
+        }
+
+        it->bodies.push_back(n);
+    }
+
+    // Drop planes that no longer have any water on them
+    for (water_plane& plane : m_water_planes) {
+        if (plane.bodies.empty()) plane.destroy();
+    }
+
+    m_water_planes.erase(std::remove_if(m_water_planes.begin(), m_water_planes.end(),
+                                        [](const water_plane& p) { return p.bodies.empty(); }), m_water_planes.end());
+}
+
+void application::update_residency(camera* cam, glm::mat4& view_mat, glm::mat4& proj_mat) {
+
+    // Same frustum planes as the water test
+    glm::mat4 view_proj { glm::transpose(proj_mat * view_mat) };
+    glm::vec4 planes[5] { view_proj[3] + view_proj[0], view_proj[3] - view_proj[0],
+                          view_proj[3] + view_proj[1], view_proj[3] - view_proj[1], view_proj[3] };
+
+    // Pixels covered by something one unit across, one unit from the camera
+    float pixels_per_unit = m_render_height / (2.0f * glm::tan(glm::radians(cam->m_fov) * 0.5f));
+    glm::vec3 cam_pos { cam->position() };
+
+    std::vector<scene_node*> renderers {};
+    m_scene->root->get_renderers(renderers);
+
+    for (scene_node* n : renderers) {
+        renderer* r = static_cast<renderer*>(n->component);
+        aabb bounds { r->world_bounds() };
+
+        bool inside = true;
+        for (int i = 0 ; i < 5 && inside ; i += 1) inside = bounds.reaches(planes[i]);
+        if (!inside) continue;
+
+        // Assumes each texture is stretched once over the object; the nearest point of its bounds gives the largest size
+        float size = glm::length(bounds.extent());
+        float pixels = size * pixels_per_unit / glm::max(bounds.distance(cam_pos), cam->m_near);
+
+        for (const material& m : r->m_mesh.materials()) {
+            if (m.diffuse_texture) residency().need(m.diffuse_texture, pixels, m_frame);
+            if (m.specular_texture) residency().need(m.specular_texture, pixels, m_frame);
+        }
+    }
+
+    // The engine's own textures are sampled across the whole screen, and the noise texel by texel
+    for (texture* t : { m_noise_texture, m_dudv_texture, m_normal_texture }) {
+        if (t) residency().need(t, static_cast<float>(m_render_width), m_frame);
+    }
+
+    residency().update(m_frame);
+}
+
+bool application::water_visible(water_plane& plane, glm::mat4& view_mat, glm::mat4& proj_mat) {
+
+    // Frustum test; the side planes, and the camera plane, as the projection has no far plane
+    glm::mat4 view_proj { glm::transpose(proj_mat * view_mat) };
+    glm::vec4 planes[5] { view_proj[3] + view_proj[0], view_proj[3] - view_proj[0],
+                          view_proj[3] + view_proj[1], view_proj[3] - view_proj[1], view_proj[3] };
+
+    plane.in_frustum.clear();
+
+    for (scene_node* n : plane.bodies) {
+        aabb bounds { static_cast<renderer*>(n->component)->world_bounds() };
+
+        bool inside = true;
+        for (int i = 0 ; i < 5 && inside ; i += 1) inside = bounds.reaches(planes[i]);
+
+        if (inside) plane.in_frustum.push_back(n);
+    }
+
+    if (plane.in_frustum.empty()) {
+        // Assume it's visible when it comes back into view, rather than trusting an old query
+        plane.occluded = false;
+        return false;
+    }
+
+    // Collect the last query's result if it has arrived, otherwise keep going with the one before
+    if (plane.query_pending) {
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(plane.query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+        if (available != GL_FALSE) {
+            GLuint any_samples = GL_FALSE;
+            glGetQueryObjectuiv(plane.query, GL_QUERY_RESULT, &any_samples);
+
+            plane.occluded = any_samples == GL_FALSE;
+            plane.query_pending = false;
+        }
+    }
+
+    return !plane.occluded;
+}
+
+void application::query_water_occlusion(water_plane& plane, glm::mat4& view_mat, glm::mat4& proj_mat, fbo& target) {
+
+    // Test the water's surface against the depth of the opaque scene, without drawing anything
+    if (!plane.in_frustum.empty() && !plane.query_pending) {
+        target.bind_for_writing();
+
+        glEnable(GL_DEPTH_TEST);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+
+        m_depthpipeline.enable();
+        m_depthpipeline.set_uniform(pipeline::UNIFORM_VIEW_MAT, view_mat);
+        m_depthpipeline.set_uniform(pipeline::UNIFORM_PROJ_MAT, proj_mat);
+
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, plane.query);
+
+        for (scene_node* n : plane.in_frustum) {
+            renderer* water = static_cast<renderer*>(n->component);
+
+            glm::mat4 model_mat { water->m_transform.get_model_matrix() };
+            m_depthpipeline.set_uniform(pipeline::UNIFORM_MODEL_MAT, model_mat);
+
+            water->m_mesh.render();
+        }
+
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
+
+        plane.query_pending = true;
+    }
+}
+
+// Planes transform by the inverse transpose
+static glm::vec4 view_space_plane(const glm::mat4& view_mat, const glm::vec4& world_plane) {
+    return glm::transpose(glm::inverse(view_mat)) * world_plane;
+}
+
+// Window depth is dot(row, view_pos) / w; with clip control that's the projection's depth row, and otherwise the
+// average of its depth and w rows, as clip depth is mapped from [-1, 1]
+static glm::vec4 window_depth_row(const glm::mat4& proj_mat) {
+    glm::vec4 depth_row { proj_mat[0][2], proj_mat[1][2], proj_mat[2][2], proj_mat[3][2] };
+    if (gl_has_clip_control()) return depth_row;
+
+    glm::vec4 w_row { proj_mat[0][3], proj_mat[1][3], proj_mat[2][3], proj_mat[3][3] };
+    return (depth_row + w_row) * 0.5f;
+}
+
+void application::render_reflection(camera* cam, std::vector<directional_light*>& d_lights, std::vector<point_light*>& p_lights,
+                                    glm::mat4& proj_mat, water_plane& plane) {
+
+    float water_height = plane.height;
+
+    // Mirror a copy of the camera under the water, and clip at the surface with an oblique near plane
+    camera reflect_cam { *cam };
+    reflect_cam.m_pos.y -= 2 * (cam->m_pos.y - water_height);
+    reflect_cam.rotate({ 0, -2 * cam->m_mouse.y }, false);
+
+    glm::vec4 reflect_plane { 0, 1, 0, -water_height };
+    glm::mat4 reflect_view { reflect_cam.get_view_matrix() };
+    glm::mat4 reflect_proj { reflect_cam.get_oblique_perspective_matrix(view_space_plane(reflect_view, reflect_plane)) };
+
+    // Only the most prominent point lights above the water are used; those with the most reach past the camera
+    std::vector<point_light*> lights {};
+
+    for (point_light* l : p_lights) {
+        if (l->transform.pos.y + l->radius() > water_height) lights.push_back(l);
+    }
+
+    std::size_t max_lights = static_cast<std::size_t>(glm::max(cam->m_reflection_lights, 0));
+
+    if (lights.size() > max_lights) {
+        glm::vec3 eye { cam->position() };
+        auto prominence = [eye](point_light* l) { return l->radius() - glm::length(l->transform.pos - eye); };
+
+        std::partial_sort(lights.begin(), lights.begin() + max_lights, lights.end(),
+                          [&prominence](point_light* a, point_light* b) { return prominence(a) > prominence(b); });
+        lights.resize(max_lights);
+    }
+
+    // Clusters only depend on the field of view, which the oblique projection keeps
+    m_reflection_clusters.build(lights, reflect_view, proj_mat, reflect_cam.m_near, reflect_cam.m_far);
+
+    // Skip anything entirely under the water, or too far away to make out in the reflection
+    std::vector<scene_node*> renderers {};
+    m_scene->root->get_renderers(renderers);
+
+    std::vector<scene_node*> visible {};
+
+    for (scene_node* n : renderers) {
+        renderer* r = static_cast<renderer*>(n->component);
+        if (r->m_pipeline != m_reflectionpipeline.identifier()) continue;
+
+        aabb bounds { r->world_bounds() };
+        if (bounds.max.y < water_height) continue;
+        if (bounds.distance(cam->position()) > cam->m_reflection_distance) continue;
+
+        visible.push_back(n);
+    }
+
+    plane.reflection_map.bind_for_writing();
+
+    glm::vec3 now = sky_colour();
+    glClearColor(now.r, now.g, now.b, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glEnable(GL_DEPTH_TEST);
+    glCullFace(GL_BACK);
+
+    m_reflectionpipeline.enable(lighting_features(&reflect_cam, m_reflection_clusters) | PIPELINE_FEATURE_REFLECTION);
+
+    m_reflectionpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_DIFFUSE, DIFFUSE_TEX_UNIT_INDEX);
+    m_reflectionpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_SPECULAR, SPECULAR_TEX_UNIT_INDEX);
+    m_reflectionpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_MATERIALS, MATERIAL_TABLE_TEX_UNIT_INDEX);
 
-    // Refraction pass
-    m_refractionmap.bind_for_writing();
+    set_lighting_uniforms(m_reflectionpipeline, &reflect_cam, d_lights, m_reflection_clusters, reflect_view, reflect_proj);
 
-    glm::vec4 refract_normal { 0, -1, 0, water->m_transform.pos.y };
-    m_lightpipeline.set_uniform(pipeline::UNIFORM_CLIP_PLANE, refract_normal);
+    for (scene_node* n : visible) n->cmp_render(this, m_scene, n, &m_reflectionpipeline);
 
-    render_lighting(cam, d_lights, p_lights, view_mat, proj_mat, shadow_mat, true);
+    plane.reflection_matrix = reflect_proj * reflect_view;
+    plane.reflection_frame = m_frame;
+    plane.reflection_valid = true;
 
-    // Clean up
-    m_lightpipeline.set_uniform(pipeline::UNIFORM_CLIP_ENABLED, 0.0f);
+    gl_error_check_barrier
+}
+
+void application::update_reflection_probes(camera* cam, std::vector<directional_light*>& d_lights, std::vector<point_light*>& p_lights) {
+
+    // Captures are kept, so they wait until the scene's textures have all arrived
+    if (!texture_stream().idle()) return;
+
+    for (reflection_probe* probe : m_scene->get_reflection_probes()) {
+        if (probe->captured) continue;
+        if (!probe->ignore_cache() && probe->load_cache()) continue;
+
+        capture_reflection_probe(cam, d_lights, p_lights, *probe);
+    }
+}
+
+void application::capture_reflection_probe(camera* cam, std::vector<directional_light*>& d_lights, std::vector<point_light*>& p_lights,
+                                    reflection_probe& probe) {
+
+    // Faces in GL_TEXTURE_CUBE_MAP_POSITIVE_X order; the up vectors follow the cubemap's face orientations
+    static const glm::vec3 face_forward[6] { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+    static const glm::vec3 face_up[6] { { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 } };
+
+    probe.allocate();
+
+    if (m_probe_capture.m_fbo == 0 || m_probe_capture.m_pixel_width != probe.resolution) {
+        m_probe_capture.destroy();
+        m_probe_capture.initialise(probe.resolution, probe.resolution, false, true, false, GL_DEPTH_COMPONENT32F);
+    }
+
+    camera probe_cam { *cam };
+    probe_cam.m_pos = probe.position;
+    probe_cam.m_fov = 90;
+    probe_cam.m_aspect = 1;
+
+    glm::mat4 probe_proj { probe_cam.get_perspective_matrix() };
+
+    // Faces are only read back when there's somewhere to cache them
+    std::size_t face_size = probe.resolution * probe.resolution * 4;
+    std::vector<unsigned char> faces {};
+    if (!probe.cache.empty()) faces.resize(6 * face_size);
+
+    glm::vec3 now = sky_colour();
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    for (int i = 0 ; i < 6 ; i += 1) {
+        probe_cam.m_facing = face_forward[i];
+        probe_cam.m_up = face_up[i];
+
+        glm::mat4 probe_view { probe_cam.get_view_matrix() };
+        m_reflection_clusters.build(p_lights, probe_view, probe_proj, probe_cam.m_near, probe_cam.m_far);
+
+        m_probe_capture.bind_for_writing();
+
+        glClearColor(now.r, now.g, now.b, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        glEnable(GL_DEPTH_TEST);
+        glCullFace(GL_BACK);
+
+        m_reflectionpipeline.enable(lighting_features(&probe_cam, m_reflection_clusters) | PIPELINE_FEATURE_REFLECTION);
+
+        m_reflectionpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_DIFFUSE, DIFFUSE_TEX_UNIT_INDEX);
+        m_reflectionpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_SPECULAR, SPECULAR_TEX_UNIT_INDEX);
+        m_reflectionpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_MATERIALS, MATERIAL_TABLE_TEX_UNIT_INDEX);
+
+        set_lighting_uniforms(m_reflectionpipeline, &probe_cam, d_lights, m_reflection_clusters, probe_view, probe_proj);
+
+        m_scene->render(this, &m_reflectionpipeline);
+
+        probe.bind(PROBE_TEX_UNIT0);
+        glCopyTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 0, 0, 0, 0, probe.resolution, probe.resolution);
+
+        if (!faces.empty()) {
+            glReadPixels(0, 0, probe.resolution, probe.resolution, GL_RGBA, GL_UNSIGNED_BYTE, &faces[i * face_size]);
+        }
+    }
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    if (!faces.empty()) probe.write_cache(faces);
+    probe.set_captured();
+
+    gl_error_check_barrier
+}
+
+// The captured probes whose influence reaches the bounds, nearest first
+static void select_reflection_probes(const std::vector<reflection_probe*>& probes, const aabb& bounds,
+                                     std::vector<reflection_probe*>& selected) {
+    selected.clear();
+
+    for (reflection_probe* probe : probes) {
+        if (probe->captured && bounds.distance(probe->position) <= probe->radius) selected.push_back(probe);
+    }
+
+    std::sort(selected.begin(), selected.end(), [&bounds](reflection_probe* a, reflection_probe* b) {
+        return bounds.distance(a->position) < bounds.distance(b->position);
+    });
+
+    if (selected.size() > MAX_BLENDED_PROBES) selected.resize(MAX_BLENDED_PROBES);
+}
+
+void application::build_depth_pyramid(fbo& source, fbo& pyramid) {
+
+    // Depth is written from the shader, so every fragment must pass
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_ALWAYS);
+
+    m_depthpyramidpipeline.enable();
+    m_depthpyramidpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_DEPTH0, DEPTH_TEX_UNIT0_INDEX);
+
+    glBindVertexArray(m_empty_vao);
+
+    // The first level is reduced from the refraction copy, and each after that from the level before it
+    for (int i = 0 ; i < pyramid.m_levels ; i += 1) {
+        if (i == 0) source.bind_depth_for_reading(DEPTH_TEX_UNIT0);
+        else pyramid.bind_levels_for_reading(i - 1, i - 1, DEPTH_TEX_UNIT0);
+
+        pyramid.bind_level_for_writing(i);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    glBindVertexArray(0);
+
+    glDepthFunc(GL_GREATER);
+}
+
+void application::render_water_reflections(camera* cam, std::vector<directional_light*>& d_lights, std::vector<point_light*>& p_lights,
+                                    glm::mat4& proj_mat, std::vector<water_plane*>& visible) {
 
+    // Only redrawn every few frames; the nearest plane gets the full resolution, scaled along with the view's
+    float scale = m_resolution.scale();
+
+    for (std::size_t i = 0 ; i < visible.size() ; i += 1) {
+        water_plane& plane = *visible[i];
+
+        int divisor = i == 0 ? 1 : WATER_SECONDARY_REFLECTION_DIVISOR;
+        int reflection_width = glm::max(static_cast<int>(DEFAULT_REFLECTION_MAP_WIDTH * scale) / divisor, 1);
+        int reflection_height = glm::max(static_cast<int>(DEFAULT_REFLECTION_MAP_HEIGHT * scale) / divisor, 1);
+
+        if (plane.reflection_map.m_fbo == 0 || plane.reflection_map.m_pixel_width != reflection_width) {
+            plane.reflection_map.destroy();
+            plane.reflection_map.initialise(reflection_width, reflection_height, false, true, false, GL_DEPTH_COMPONENT32F);
+            plane.reflection_valid = false;
+        }
+
+        bool due = m_frame - plane.reflection_frame >= static_cast<unsigned int>(glm::max(cam->m_reflection_interval, 1));
+        if (!plane.reflection_valid || due) render_reflection(cam, d_lights, p_lights, proj_mat, plane);
+    }
+}
+
+void application::render_water(camera* cam, std::vector<directional_light*>& d_lights, glm::mat4& view_mat, glm::mat4& proj_mat,
+                                    std::vector<water_plane*>& visible, fbo& target, fbo& refraction, fbo* depth_pyramid) {
+
+    bool planar = cam->m_water_reflection != WATER_REFLECTION_SCREEN_SPACE && cam->m_water_reflection != WATER_REFLECTION_PROBE;
 
     // Render the water to the main FBO
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glViewport(0, 0, width(), height());
+    target.bind_for_writing();
 
     glEnable(GL_DEPTH_TEST);
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    m_reflectionmap.bind_color_for_reading(REFLECT_TEX_UNIT);
-    m_refractionmap.bind_color_for_reading(REFRACT_TEX_UNIT);
-    m_refractionmap.bind_depth_for_reading(DEPTH_TEX_UNIT0);
+    refraction.bind_target_for_reading(0, REFRACT_TEX_UNIT);
+    refraction.bind_depth_for_reading(DEPTH_TEX_UNIT0);
+    if (depth_pyramid) depth_pyramid->bind_levels_for_reading(0, depth_pyramid->m_levels - 1, DEPTH_PYRAMID_TEX_UNIT);
     m_dudv_texture->bind(DUDV_TEX_UNIT);
     m_normal_texture->bind(NORMAL_TEX_UNIT);
 
@@ -351,15 +1285,132 @@ void application::render_water(camera* cam, std::vector<directional_light*>& d_l
     m_waterpipeline.set_uniform(pipeline::UNIFORM_PROJ_MAT, proj_mat);
 
     m_waterpipeline.set_uniform(pipeline::UNIFORM_CAMERA_POS, cam->position());
+    m_waterpipeline.set_uniform(pipeline::UNIFORM_REFRACTION_DEPTH, window_depth_row(proj_mat));
+    m_waterpipeline.set_uniform(pipeline::UNIFORM_CAMERA_NEAR, cam->m_near);
     m_waterpipeline.set_uniform(pipeline::UNIFORM_CAMERA_FAR, cam->m_far);
 
+    m_waterpipeline.set_uniform(pipeline::UNIFORM_REFLECTION_MODE, cam->m_water_reflection);
+    m_waterpipeline.set_uniform(pipeline::UNIFORM_REFLECTION_DISTANCE, cam->m_reflection_distance);
+    m_waterpipeline.set_uniform(pipeline::UNIFORM_SKY_COLOR, sky_colour());
+    m_waterpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_DEPTH_PYRAMID, DEPTH_PYRAMID_TEX_UNIT_INDEX);
+    m_waterpipeline.set_uniform(pipeline::UNIFORM_DEPTH_PYRAMID_LEVELS, DEPTH_PYRAMID_LEVELS);
+    m_waterpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_PROBE0, PROBE_TEX_UNIT0_INDEX);
+    m_waterpipeline.set_uniform(pipeline::UNIFORM_SAMPLER_PROBE1, PROBE_TEX_UNIT1_INDEX);
+
+    std::vector<reflection_probe*> probes {};
+    if (!planar) probes = m_scene->get_reflection_probes();
+
+    std::vector<reflection_probe*> nearby {};
+
     m_waterpipeline.set_uniform(pipeline::UNIFORM_DIR_LIGHTS, d_lights);
 
     m_waterpipeline.set_uniform(pipeline::UNIFORM_TIME, time());
 
-    m_scene->render(this, &m_waterpipeline);
+    // Each plane's bodies are drawn with its own reflection
+    for (water_plane* plane : visible) {
+        if (planar) {
+            plane->reflection_map.bind_color_for_reading(REFLECT_TEX_UNIT);
+            m_waterpipeline.set_uniform(pipeline::UNIFORM_REFLECTION_MAT, plane->reflection_matrix);
+        }
+
+        for (scene_node* n : plane->bodies) {
+            // Otherwise, each body blends the probes nearest to it
+            if (!planar) {
+                select_reflection_probes(probes, static_cast<renderer*>(n->component)->world_bounds(), nearby);
+                m_waterpipeline.set_uniform(pipeline::UNIFORM_REFLECTION_PROBES, nearby);
+
+                for (std::size_t i = 0 ; i < nearby.size() ; i += 1) nearby[i]->bind(i == 0 ? PROBE_TEX_UNIT0 : PROBE_TEX_UNIT1);
+            }
+
+            n->cmp_render(this, m_scene, n, &m_waterpipeline);
+        }
+    }
 
     glDisable(GL_BLEND);
 
     gl_error_check_barrier
 }
+
+void application::present(camera* cam, fbo& view) {
+    if (cam->m_upscale_filter != UPSCALE_CATMULL_ROM || (view.m_pixel_width == width() && view.m_pixel_height == height())) {
+        view.blit_to_screen(width(), height());
+        return;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, width(), height());
+    glDisable(GL_DEPTH_TEST);
+
+    // The filter's taps are bilinear; the view's targets are otherwise only read texel by texel
+    view.bind_target_for_reading(0, DIFFUSE_TEX_UNIT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    m_upscalepipeline.enable();
+    m_upscalepipeline.set_uniform(pipeline::UNIFORM_SAMPLER_COLOR, DIFFUSE_TEX_UNIT_INDEX);
+
+    glBindVertexArray(m_empty_vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glEnable(GL_DEPTH_TEST);
+
+    gl_error_check_barrier
+}
+
+void application::register_passes() {
+
+    // Reflection probes are only drawn once, the first frame they're needed, unless they were cached
+    m_graph.register_passes(RENDER_STAGE_BEFORE_LIGHTING, [this](render_graph& g) {
+        g.add_pass("reflection probes", { g.find("shadow maps") }, { g.find("reflection probes") }, [this]() {
+            update_reflection_probes(m_frame_state.cam, m_frame_state.d_lights, m_frame_state.p_lights);
+        });
+    });
+
+    // Nearest depths of the refraction copy, for screen-space water reflections to trace through
+    m_graph.register_passes(RENDER_STAGE_BEFORE_WATER, [this](render_graph& g) {
+        render_target_desc pyramid_desc { {}, GL_DEPTH_COMPONENT32F, 2, 0, 0, DEPTH_PYRAMID_LEVELS };
+
+        render_graph::resource refraction = g.find("refraction");
+        render_graph::resource depth_pyramid = g.create_target("depth pyramid", pyramid_desc);
+
+        g.add_pass("depth pyramid", { refraction }, { depth_pyramid }, [this, &g, refraction, depth_pyramid]() {
+            build_depth_pyramid(g.target(refraction), g.target(depth_pyramid));
+        });
+    });
+}
+
+void application::update_profiler_overlay(camera* cam) {
+    if (!cam->m_profiler_overlay) {
+        if (m_profiler_overlay_shown) SDL_SetWindowTitle(m_window, WINDOW_TITLE);
+        m_profiler_overlay_shown = false;
+        return;
+    }
+
+    if (m_profiler_overlay_shown && m_frame % PROFILER_OVERLAY_FRAMES != 0) return;
+
+    // GPU and then CPU milliseconds; only CPU where the GPU can't be timed
+    bool gpu = m_profiler.gpu_timing();
+    auto times = [gpu](std::ostringstream& out, const gpu_profiler::timing& t) {
+        if (gpu) out << t.gpu_ms << "/";
+        out << t.cpu_ms;
+    };
+
+    std::ostringstream title {};
+    title << std::fixed << std::setprecision(2);
+    title << WINDOW_TITLE << " - " << static_cast<int>(m_resolution.scale() * 100) << "% - " << (gpu ? "gpu/cpu ms " : "cpu ms ");
+
+    times(title, m_profiler.frame_timing());
+
+    for (const gpu_profiler::timing& t : m_profiler.timings()) {
+        title << " | " << t.name << " ";
+        times(title, t);
+    }
+
+    SDL_SetWindowTitle(m_window, title.str().c_str());
+    m_profiler_overlay_shown = true;
+}
@@ -0,0 +1,327 @@
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+
+#include "bvh.h"
+#include "bounds.h"
+
+//
+//
+// Generic builder
+//
+//
+
+void bvh::build(const std::vector<aabb>& primitive_bounds, unsigned int max_leaf_size) {
+    m_nodes.clear();
+    m_indices.clear();
+
+    unsigned int count = primitive_bounds.size();
+    if (count == 0) return;
+
+    std::vector<glm::vec3> centroids {};
+    centroids.reserve(count);
+    m_indices.reserve(count);
+
+    for (unsigned int i = 0 ; i < count ; i += 1) {
+        centroids.push_back(primitive_bounds[i].centre());
+        m_indices.push_back(i);
+    }
+
+    // A binary tree with one primitive per leaf has 2n - 1 nodes; the extra one pads the sibling pairs
+    m_nodes.reserve(2 * count);
+
+    bvh_node root {};
+    root.left_first = 0;
+    root.count = count;
+    m_nodes.push_back(root);
+
+    subdivide(0, primitive_bounds, centroids, std::max(max_leaf_size, 1u), 0);
+}
+
+aabb bvh::bounds() const {
+    if (m_nodes.empty()) return {};
+    return { m_nodes[0].min, m_nodes[0].max };
+}
+
+void bvh::subdivide(unsigned int node_index, const std::vector<aabb>& primitive_bounds,
+                    const std::vector<glm::vec3>& centroids, unsigned int max_leaf_size, int depth) {
+
+    unsigned int first = m_nodes[node_index].left_first;
+    unsigned int count = m_nodes[node_index].count;
+
+    // Fit the node around its primitives
+    aabb node_bounds {};
+    aabb centroid_bounds {};
+
+    for (unsigned int i = first ; i < first + count ; i += 1) {
+        node_bounds.grow(primitive_bounds[m_indices[i]]);
+        centroid_bounds.grow(centroids[m_indices[i]]);
+    }
+
+    m_nodes[node_index].min = node_bounds.min;
+    m_nodes[node_index].max = node_bounds.max;
+
+    if (count <= 1 || depth >= BVH_MAX_DEPTH - 1) return;
+
+    // Binned SAH; find the cheapest bin boundary over all three axes
+    struct bin {
+        aabb bounds {};
+        unsigned int count { 0 };
+    };
+
+    float best_cost = std::numeric_limits<float>::max();
+    int best_axis = -1;
+    int best_split = 0;
+
+    glm::vec3 centroid_extent { centroid_bounds.extent() };
+
+    // Degenerate geometry can make SAH peel off one primitive at a time; past half the
+    // depth budget, only balanced splits are made so the traversal stack cannot overflow
+    bool use_sah = depth < BVH_MAX_DEPTH / 2;
+
+    for (int axis = 0 ; use_sah && axis < 3 ; axis += 1) {
+        if (centroid_extent[axis] <= 1e-6f) continue;
+
+        bin bins[BVH_SAH_BINS] {};
+        float scale = BVH_SAH_BINS / centroid_extent[axis];
+
+        for (unsigned int i = first ; i < first + count ; i += 1) {
+            unsigned int p = m_indices[i];
+            int b = std::min(BVH_SAH_BINS - 1, static_cast<int>((centroids[p][axis] - centroid_bounds.min[axis]) * scale));
+            bins[b].count += 1;
+            bins[b].bounds.grow(primitive_bounds[p]);
+        }
+
+        // Sweep from both sides to get the area and count on either side of every boundary
+        float left_area[BVH_SAH_BINS - 1], right_area[BVH_SAH_BINS - 1];
+        unsigned int left_count[BVH_SAH_BINS - 1], right_count[BVH_SAH_BINS - 1];
+        aabb left_box {}, right_box {};
+        unsigned int left_sum = 0, right_sum = 0;
+
+        for (int i = 0 ; i < BVH_SAH_BINS - 1 ; i += 1) {
+            left_sum += bins[i].count;
+            left_count[i] = left_sum;
+            left_box.grow(bins[i].bounds);
+            left_area[i] = left_box.surface_area();
+
+            right_sum += bins[BVH_SAH_BINS - 1 - i].count;
+            right_count[BVH_SAH_BINS - 2 - i] = right_sum;
+            right_box.grow(bins[BVH_SAH_BINS - 1 - i].bounds);
+            right_area[BVH_SAH_BINS - 2 - i] = right_box.surface_area();
+        }
+
+        for (int i = 0 ; i < BVH_SAH_BINS - 1 ; i += 1) {
+            if (left_count[i] == 0 || right_count[i] == 0) continue;
+
+            float cost = left_count[i] * left_area[i] + right_count[i] * right_area[i];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = i;
+            }
+        }
+    }
+
+    // Is splitting cheaper than intersecting everything in this node?
+    float leaf_cost = count * node_bounds.surface_area();
+    bool must_split = count > max_leaf_size;
+
+    if (!must_split && best_cost >= leaf_cost) return;
+
+    unsigned int mid = first;
+
+    if (best_axis >= 0) {
+        float scale = BVH_SAH_BINS / centroid_extent[best_axis];
+        unsigned int* begin = m_indices.data() + first;
+        unsigned int* end = begin + count;
+
+        unsigned int* split = std::partition(begin, end, [&](unsigned int p) {
+            int b = std::min(BVH_SAH_BINS - 1, static_cast<int>((centroids[p][best_axis] - centroid_bounds.min[best_axis]) * scale));
+            return b <= best_split;
+        });
+
+        mid = first + (split - begin);
+    }
+
+    // Every centroid fell into the same place; fall back to halving the range
+    if (mid == first || mid == first + count) {
+        if (!must_split) return;
+        mid = first + count / 2;
+    }
+
+    unsigned int left_index = m_nodes.size();
+
+    bvh_node left {};
+    left.left_first = first;
+    left.count = mid - first;
+
+    bvh_node right {};
+    right.left_first = mid;
+    right.count = first + count - mid;
+
+    m_nodes.push_back(left);
+    m_nodes.push_back(right);
+
+    m_nodes[node_index].left_first = left_index;
+    m_nodes[node_index].count = 0;
+
+    subdivide(left_index, primitive_bounds, centroids, max_leaf_size, depth + 1);
+    subdivide(left_index + 1, primitive_bounds, centroids, max_leaf_size, depth + 1);
+}
+
+//
+//
+// Triangle BVH
+//
+//
+
+void triangle_bvh::build(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& triangle_indices) {
+    unsigned int num_triangles = triangle_indices.size() / 3;
+
+    std::vector<aabb> triangle_bounds {};
+    triangle_bounds.reserve(num_triangles);
+
+    for (unsigned int i = 0 ; i < num_triangles ; i += 1) {
+        aabb b {};
+        b.grow(positions[triangle_indices[3 * i + 0]]);
+        b.grow(positions[triangle_indices[3 * i + 1]]);
+        b.grow(positions[triangle_indices[3 * i + 2]]);
+        triangle_bounds.push_back(b);
+    }
+
+    m_bvh.build(triangle_bounds, TRIANGLE_PACKET_SIZE);
+
+    // Pack every leaf's triangles into one packet; the leaf then refers to its packet instead
+    m_packets.clear();
+
+    for (bvh_node& n : m_bvh.m_nodes) {
+        if (!n.is_leaf()) continue;
+
+        triangle_packet packet {};
+
+        for (unsigned int lane = 0 ; lane < TRIANGLE_PACKET_SIZE ; lane += 1) {
+            // Unused lanes are degenerate triangles, which never report a hit
+            if (lane >= n.count) {
+                packet.id[lane] = 0;
+                continue;
+            }
+
+            unsigned int t = m_bvh.m_indices[n.left_first + lane];
+            glm::vec3 v0 { positions[triangle_indices[3 * t + 0]] };
+            glm::vec3 e1 { positions[triangle_indices[3 * t + 1]] - v0 };
+            glm::vec3 e2 { positions[triangle_indices[3 * t + 2]] - v0 };
+
+            packet.v0_x[lane] = v0.x; packet.v0_y[lane] = v0.y; packet.v0_z[lane] = v0.z;
+            packet.e1_x[lane] = e1.x; packet.e1_y[lane] = e1.y; packet.e1_z[lane] = e1.z;
+            packet.e2_x[lane] = e2.x; packet.e2_y[lane] = e2.y; packet.e2_z[lane] = e2.z;
+            packet.id[lane] = t;
+        }
+
+        n.left_first = m_packets.size();
+        m_packets.push_back(packet);
+    }
+}
+
+// Möller-Trumbore against four triangles at once. Returns the lane of the closest hit nearer than t_max, or -1.
+static int intersect_packet(const bvh_ray& r, const triangle_packet& p, float& t_max) {
+    const float epsilon = 1e-8f;
+
+#ifdef BVH_SIMD
+    __m128 dir_x = _mm_set1_ps(r.dir.x), dir_y = _mm_set1_ps(r.dir.y), dir_z = _mm_set1_ps(r.dir.z);
+
+    __m128 e1_x = _mm_load_ps(p.e1_x), e1_y = _mm_load_ps(p.e1_y), e1_z = _mm_load_ps(p.e1_z);
+    __m128 e2_x = _mm_load_ps(p.e2_x), e2_y = _mm_load_ps(p.e2_y), e2_z = _mm_load_ps(p.e2_z);
+
+    // p = dir x e2
+    __m128 p_x = _mm_sub_ps(_mm_mul_ps(dir_y, e2_z), _mm_mul_ps(dir_z, e2_y));
+    __m128 p_y = _mm_sub_ps(_mm_mul_ps(dir_z, e2_x), _mm_mul_ps(dir_x, e2_z));
+    __m128 p_z = _mm_sub_ps(_mm_mul_ps(dir_x, e2_y), _mm_mul_ps(dir_y, e2_x));
+
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1_x, p_x), _mm_mul_ps(e1_y, p_y)), _mm_mul_ps(e1_z, p_z));
+    __m128 abs_det = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+    __m128 valid = _mm_cmpgt_ps(abs_det, _mm_set1_ps(epsilon));
+    __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+    // s = origin - v0
+    __m128 s_x = _mm_sub_ps(_mm_set1_ps(r.origin.x), _mm_load_ps(p.v0_x));
+    __m128 s_y = _mm_sub_ps(_mm_set1_ps(r.origin.y), _mm_load_ps(p.v0_y));
+    __m128 s_z = _mm_sub_ps(_mm_set1_ps(r.origin.z), _mm_load_ps(p.v0_z));
+
+    __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(s_x, p_x), _mm_mul_ps(s_y, p_y)), _mm_mul_ps(s_z, p_z)), inv_det);
+
+    // q = s x e1
+    __m128 q_x = _mm_sub_ps(_mm_mul_ps(s_y, e1_z), _mm_mul_ps(s_z, e1_y));
+    __m128 q_y = _mm_sub_ps(_mm_mul_ps(s_z, e1_x), _mm_mul_ps(s_x, e1_z));
+    __m128 q_z = _mm_sub_ps(_mm_mul_ps(s_x, e1_y), _mm_mul_ps(s_y, e1_x));
+
+    __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dir_x, q_x), _mm_mul_ps(dir_y, q_y)), _mm_mul_ps(dir_z, q_z)), inv_det);
+    __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2_x, q_x), _mm_mul_ps(e2_y, q_y)), _mm_mul_ps(e2_z, q_z)), inv_det);
+
+    __m128 zero = _mm_setzero_ps();
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+    valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+    valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, _mm_set1_ps(epsilon)));
+    valid = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(t_max)));
+
+    int mask = _mm_movemask_ps(valid);
+    if (mask == 0) return -1;
+
+    alignas(16) float ts[4];
+    _mm_store_ps(ts, t);
+#else
+    float ts[4];
+    int mask = 0;
+
+    for (int lane = 0 ; lane < TRIANGLE_PACKET_SIZE ; lane += 1) {
+        glm::vec3 e1 { p.e1_x[lane], p.e1_y[lane], p.e1_z[lane] };
+        glm::vec3 e2 { p.e2_x[lane], p.e2_y[lane], p.e2_z[lane] };
+        glm::vec3 v0 { p.v0_x[lane], p.v0_y[lane], p.v0_z[lane] };
+
+        glm::vec3 pv { glm::cross(r.dir, e2) };
+        float det = glm::dot(e1, pv);
+        if (glm::abs(det) <= epsilon) continue;
+
+        float inv_det = 1.0f / det;
+        glm::vec3 s { r.origin - v0 };
+        float u = glm::dot(s, pv) * inv_det;
+        glm::vec3 q { glm::cross(s, e1) };
+        float v = glm::dot(r.dir, q) * inv_det;
+        ts[lane] = glm::dot(e2, q) * inv_det;
+
+        if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && ts[lane] > epsilon && ts[lane] < t_max) mask |= 1 << lane;
+    }
+
+    if (mask == 0) return -1;
+#endif
+
+    int closest = -1;
+    for (int lane = 0 ; lane < TRIANGLE_PACKET_SIZE ; lane += 1) {
+        if ((mask & (1 << lane)) && ts[lane] < t_max) {
+            t_max = ts[lane];
+            closest = lane;
+        }
+    }
+
+    return closest;
+}
+
+bool triangle_bvh::intersect(const ray& r, float& t_max, unsigned int& triangle) const {
+    bvh_ray br { r };
+    bool hit = false;
+
+    m_bvh.traverse(br, t_max, [&](const bvh_node& leaf, float& t) {
+        const triangle_packet& packet = m_packets[leaf.left_first];
+        int lane = intersect_packet(br, packet, t);
+
+        if (lane >= 0) {
+            triangle = packet.id[lane];
+            hit = true;
+        }
+    });
+
+    return hit;
+}
@@ -1,4 +1,5 @@
 #include "camera.h"
+#include "utilities.h"
 
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/mat4x4.hpp>
@@ -38,8 +39,53 @@ glm::mat4 camera::get_view_matrix() const {
     return glm::lookAt(m_pos, m_pos + m_facing, m_up);
 }
 
+// Reversed-Z projection with an infinite far plane; window depth is near / w, from 1 at the near plane towards 0.
+// With clip control, clip space z is simply the near distance; without it, clip depth is in [-1, 1], so z is
+// remapped to give the same window depth.
 glm::mat4 camera::get_perspective_matrix() const {
-    return glm::perspective(glm::radians(m_fov), m_aspect, m_near, m_far);
+    float focal_length = 1.0f / glm::tan(glm::radians(m_fov) * 0.5f);
+
+    glm::mat4 proj { 0.0f };
+    proj[0][0] = focal_length / m_aspect;
+    proj[1][1] = focal_length;
+    proj[2][3] = -1.0f;
+
+    if (gl_has_clip_control()) {
+        proj[3][2] = m_near;
+    } else {
+        proj[2][2] = 1.0f;
+        proj[3][2] = 2.0f * m_near;
+    }
+
+    return proj;
+}
+
+// Lengyel's oblique near plane, adapted to the reversed infinite projection above. The depth row becomes
+// w - a * dot(plane, v), so depth is 1 on the plane; a is chosen so depth only reaches 0 outside the view frustum.
+glm::mat4 camera::get_oblique_perspective_matrix(const glm::vec4& view_plane) const {
+    glm::mat4 proj { get_perspective_matrix() };
+
+    if (view_plane.w >= 0.0f) return proj;
+
+    // The plane reaches furthest into the frustum, per unit of view depth, along one of the frustum's corner rays
+    float reach = 0.0f;
+
+    for (int i = 0 ; i < 4 ; i += 1) {
+        glm::vec3 corner_ray { (i & 1 ? 1.0f : -1.0f) / proj[0][0], (i & 2 ? 1.0f : -1.0f) / proj[1][1], -1.0f };
+        reach = glm::max(reach, glm::dot(glm::vec3 { view_plane }, corner_ray));
+    }
+
+    float a = reach > 0.0f ? 1.0f / reach : 1.0f;
+
+    // Without clip control, window depth is half of clip depth plus a half, so the plane term is doubled
+    if (!gl_has_clip_control()) a *= 2.0f;
+
+    proj[0][2] = -a * view_plane.x;
+    proj[1][2] = -a * view_plane.y;
+    proj[2][2] = -1.0f - a * view_plane.z;
+    proj[3][2] = -a * view_plane.w;
+
+    return proj;
 }
 
 glm::vec3 camera::up() const {
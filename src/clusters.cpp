@@ -0,0 +1,243 @@
+#include <iostream>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+#include "clusters.h"
+#include "point_light.h"
+#include "workers.h"
+#include "utilities.h"
+
+void light_clusters::initialise() {
+    glGenTextures(1, &m_lights_texture);
+    glBindTexture(GL_TEXTURE_2D, m_lights_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, MAX_CLUSTERED_LIGHTS, CLUSTER_LIGHT_TEXELS, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenTextures(1, &m_clusters_texture);
+    glBindTexture(GL_TEXTURE_2D, m_clusters_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32UI, CLUSTER_X * CLUSTER_Y, CLUSTER_Z, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenTextures(1, &m_indices_texture);
+    glBindTexture(GL_TEXTURE_2D, m_indices_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, CLUSTER_INDEX_TEXTURE_WIDTH, MAX_CLUSTER_INDICES / CLUSTER_INDEX_TEXTURE_WIDTH, 0,
+                 GL_RED_INTEGER, GL_UNSIGNED_SHORT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_slice_indices.resize(CLUSTER_Z);
+    m_cluster_ranges.resize(CLUSTER_COUNT * 2);
+
+    gl_error_check_barrier
+}
+
+void light_clusters::destroy() {
+    if (m_lights_texture) glDeleteTextures(1, &m_lights_texture);
+    if (m_clusters_texture) glDeleteTextures(1, &m_clusters_texture);
+    if (m_indices_texture) glDeleteTextures(1, &m_indices_texture);
+
+    m_lights_texture = 0;
+    m_clusters_texture = 0;
+    m_indices_texture = 0;
+}
+
+void light_clusters::build_cluster_bounds(const glm::mat4& proj, float near, float far) {
+    m_bounds_proj = proj;
+    m_cluster_bounds.resize(CLUSTER_COUNT);
+
+    // With a symmetric projection, a point at view depth d and NDC x is at view x = ndc_x * d / proj[0][0]
+    float inv_scale_x = 1.0f / proj[0][0];
+    float inv_scale_y = 1.0f / proj[1][1];
+
+    for (int z = 0 ; z < CLUSTER_Z ; z += 1) {
+        float depth_near = near * glm::pow(far / near, z / static_cast<float>(CLUSTER_Z));
+        float depth_far = near * glm::pow(far / near, (z + 1) / static_cast<float>(CLUSTER_Z));
+
+        for (int y = 0 ; y < CLUSTER_Y ; y += 1) {
+            float ndc_y0 = -1.0f + 2.0f * y / CLUSTER_Y;
+            float ndc_y1 = -1.0f + 2.0f * (y + 1) / CLUSTER_Y;
+
+            for (int x = 0 ; x < CLUSTER_X ; x += 1) {
+                float ndc_x0 = -1.0f + 2.0f * x / CLUSTER_X;
+                float ndc_x1 = -1.0f + 2.0f * (x + 1) / CLUSTER_X;
+
+                aabb& b = m_cluster_bounds[(z * CLUSTER_Y + y) * CLUSTER_X + x];
+                b = {};
+
+                for (float d : { depth_near, depth_far }) {
+                    b.grow({ ndc_x0 * d * inv_scale_x, ndc_y0 * d * inv_scale_y, -d });
+                    b.grow({ ndc_x1 * d * inv_scale_x, ndc_y1 * d * inv_scale_y, -d });
+                }
+            }
+        }
+    }
+}
+
+void light_clusters::build(const std::vector<point_light*>& lights, const glm::mat4& view, const glm::mat4& proj, float near, float far) {
+    if (proj != m_bounds_proj || near != m_near || far != m_far) build_cluster_bounds(proj, near, far);
+
+    m_near = near;
+    m_far = far;
+
+    static bool warned = false;
+    if (lights.size() > MAX_CLUSTERED_LIGHTS && !warned) {
+        std::cerr << "Warning: only the first " << MAX_CLUSTERED_LIGHTS << " point lights in the scene will be drawn" << std::endl;
+        warned = true;
+    }
+
+    m_num_lights = std::min<int>(lights.size(), MAX_CLUSTERED_LIGHTS);
+
+    // Light spheres in view space
+    m_light_x.resize(m_num_lights);
+    m_light_y.resize(m_num_lights);
+    m_light_z.resize(m_num_lights);
+    m_light_radius.resize(m_num_lights);
+
+    // Light data is laid out a row per field, so that only the used columns need uploading
+    m_light_data.resize(m_num_lights * CLUSTER_LIGHT_TEXELS);
+
+    for (int i = 0 ; i < m_num_lights ; i += 1) {
+        const point_light* l = lights[i];
+        float radius = l->radius();
+
+        glm::vec3 view_pos { view * glm::vec4(l->transform.pos, 1.0f) };
+        m_light_x[i] = view_pos.x;
+        m_light_y[i] = view_pos.y;
+        m_light_z[i] = view_pos.z;
+        m_light_radius[i] = radius;
+
+        m_light_data[0 * m_num_lights + i] = { l->transform.pos, radius };
+        m_light_data[1 * m_num_lights + i] = { l->base.color, l->base.ambient_intensity };
+        m_light_data[2 * m_num_lights + i] = { l->base.diffuse_intensity, l->base.specular_intensity, 0.0f, 0.0f };
+        m_light_data[3 * m_num_lights + i] = { l->attn_const, l->attn_linear, l->attn_exp, 0.0f };
+    }
+
+    // Each slice is independent, so they're binned in parallel
+    worker_pool().parallel_for(CLUSTER_Z, 1, [this](std::size_t begin, std::size_t end) {
+        for (std::size_t z = begin ; z < end ; z += 1) bin_slice(z);
+    });
+
+    // Join the slices' index lists, and move their clusters' offsets to match
+    m_indices.clear();
+
+    for (int z = 0 ; z < CLUSTER_Z ; z += 1) {
+        GLuint base = m_indices.size();
+
+        int room = MAX_CLUSTER_INDICES - static_cast<int>(m_indices.size());
+        int count = std::min<int>(m_slice_indices[z].size(), room);
+        m_indices.insert(m_indices.end(), m_slice_indices[z].begin(), m_slice_indices[z].begin() + count);
+
+        for (int c = z * CLUSTER_X * CLUSTER_Y ; c < (z + 1) * CLUSTER_X * CLUSTER_Y ; c += 1) {
+            GLuint& offset = m_cluster_ranges[c * 2];
+            GLuint& cluster_count = m_cluster_ranges[c * 2 + 1];
+
+            // Anything that didn't fit is dropped
+            cluster_count = std::min<GLuint>(cluster_count, std::max<int>(count - static_cast<int>(offset), 0));
+            offset += base;
+        }
+    }
+
+    // Upload everything
+    if (m_num_lights > 0) {
+        glBindTexture(GL_TEXTURE_2D, m_lights_texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_num_lights, CLUSTER_LIGHT_TEXELS, GL_RGBA, GL_FLOAT, &m_light_data[0]);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, m_clusters_texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, CLUSTER_X * CLUSTER_Y, CLUSTER_Z, GL_RG_INTEGER, GL_UNSIGNED_INT, &m_cluster_ranges[0]);
+
+    if (!m_indices.empty()) {
+        int rows = (m_indices.size() + CLUSTER_INDEX_TEXTURE_WIDTH - 1) / CLUSTER_INDEX_TEXTURE_WIDTH;
+        m_indices.resize(rows * CLUSTER_INDEX_TEXTURE_WIDTH, 0);
+
+        glBindTexture(GL_TEXTURE_2D, m_indices_texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, CLUSTER_INDEX_TEXTURE_WIDTH, rows, GL_RED_INTEGER, GL_UNSIGNED_SHORT, &m_indices[0]);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void light_clusters::bin_slice(int slice) {
+    std::vector<GLushort>& indices = m_slice_indices[slice];
+    indices.clear();
+
+    // Lights whose depth range overlaps the slice; all of its clusters share the same depth bounds
+    const aabb& slice_bounds = m_cluster_bounds[slice * CLUSTER_X * CLUSTER_Y];
+
+    std::vector<int> candidates {};
+
+    for (int i = 0 ; i < m_num_lights ; i += 1) {
+        if (m_light_z[i] - m_light_radius[i] > slice_bounds.max.z) continue;
+        if (m_light_z[i] + m_light_radius[i] < slice_bounds.min.z) continue;
+        candidates.push_back(i);
+    }
+
+    int padded = (candidates.size() + 3) & ~3;
+
+    std::vector<float> cx(padded), cy(padded), cz(padded), r2(padded);
+
+    for (int i = 0 ; i < padded ; i += 1) {
+        bool real = i < static_cast<int>(candidates.size());
+        int light = real ? candidates[i] : 0;
+
+        cx[i] = m_light_x[light];
+        cy[i] = m_light_y[light];
+        cz[i] = m_light_z[light];
+        r2[i] = real ? m_light_radius[light] * m_light_radius[light] : -1.0f;
+    }
+
+    for (int c = slice * CLUSTER_X * CLUSTER_Y ; c < (slice + 1) * CLUSTER_X * CLUSTER_Y ; c += 1) {
+        const aabb& b = m_cluster_bounds[c];
+
+        m_cluster_ranges[c * 2] = indices.size();
+
+#ifdef CLUSTERS_SIMD
+        // Squared distance from each of four sphere centres to the box, against their squared radii
+        __m128 zero = _mm_setzero_ps();
+        __m128 min_x = _mm_set1_ps(b.min.x), max_x = _mm_set1_ps(b.max.x);
+        __m128 min_y = _mm_set1_ps(b.min.y), max_y = _mm_set1_ps(b.max.y);
+        __m128 min_z = _mm_set1_ps(b.min.z), max_z = _mm_set1_ps(b.max.z);
+
+        for (int i = 0 ; i < padded ; i += 4) {
+            __m128 x = _mm_loadu_ps(&cx[i]);
+            __m128 y = _mm_loadu_ps(&cy[i]);
+            __m128 z = _mm_loadu_ps(&cz[i]);
+
+            __m128 dx = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(min_x, x), _mm_sub_ps(x, max_x)));
+            __m128 dy = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(min_y, y), _mm_sub_ps(y, max_y)));
+            __m128 dz = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(min_z, z), _mm_sub_ps(z, max_z)));
+
+            __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            int hits = _mm_movemask_ps(_mm_cmple_ps(d2, _mm_loadu_ps(&r2[i])));
+
+            while (hits) {
+                int lane = __builtin_ctz(hits);
+                indices.push_back(candidates[i + lane]);
+                hits &= hits - 1;
+            }
+        }
+#else
+        for (int i = 0 ; i < padded ; i += 1) {
+            glm::vec3 centre { cx[i], cy[i], cz[i] };
+            glm::vec3 d { glm::max(glm::vec3(0.0f), glm::max(b.min - centre, centre - b.max)) };
+            if (glm::dot(d, d) <= r2[i]) indices.push_back(candidates[i]);
+        }
+#endif
+
+        m_cluster_ranges[c * 2 + 1] = indices.size() - m_cluster_ranges[c * 2];
+    }
+}
+
+void light_clusters::bind(GLenum lights_unit, GLenum clusters_unit, GLenum indices_unit) const {
+    glActiveTexture(lights_unit);
+    glBindTexture(GL_TEXTURE_2D, m_lights_texture);
+    glActiveTexture(clusters_unit);
+    glBindTexture(GL_TEXTURE_2D, m_clusters_texture);
+    glActiveTexture(indices_unit);
+    glBindTexture(GL_TEXTURE_2D, m_indices_texture);
+}
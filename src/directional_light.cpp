@@ -15,32 +15,10 @@ template<>
 void run<directional_light>(application* app, scene* scene, scene_node* this_node, directional_light* light) {
     float f = light->frequency;
     if (f > 0) {
-        light->direction = { cos(f * app->time()), light->direction[1], sin(f * app->time()) };
+        light->set_direction({ cos(f * app->time()), light->direction[1], sin(f * app->time()) });
     }
 }
 
-struct bounds {
-    float min_x {};
-    float max_x {};
-
-    float min_y {};
-    float max_y {};
-
-    float min_z {};
-    float max_z {};
-
-    void add(glm::vec3 p) {
-        min_x = glm::min(min_x, p.x);
-        max_x = glm::max(max_x, p.x);
-
-        min_y = glm::min(min_y, p.y);
-        max_y = glm::max(max_y, p.y);
-
-        min_z = glm::min(min_z, p.z);
-        max_z = glm::max(max_z, p.z);
-    }
-};
-
 struct frustum {
     glm::vec4 near_bottom_left {};
     glm::vec4 near_bottom_right {};
@@ -64,32 +42,47 @@ struct frustum {
             far_top_right: { m * far_top_right }
         };
     }
-
-    bounds bounding_box() {
-        bounds b {};
-        b.add(near_bottom_left);
-        b.add(near_bottom_right);
-        b.add(near_top_left);
-        b.add(near_top_right);
-        b.add(far_bottom_left);
-        b.add(far_bottom_right);
-        b.add(far_top_left);
-        b.add(far_top_right);
-        return b;
-    }
 };
 
 
-glm::mat4 directional_light::get_shadow_matrix(camera* camera, glm::mat4& camera_view) {
+bool shadow_volume::reaches(const aabb& caster) const {
+    if (caster.empty()) return false;
+
+    if (caster.max.x < bounds.min.x || caster.min.x > bounds.max.x) return false;
+    if (caster.max.y < bounds.min.y || caster.min.y > bounds.max.y) return false;
+
+    // Entirely beyond the far end of the volume, so it can only shadow things nobody can see
+    if (caster.max.z < bounds.min.z) return false;
+
+    return true;
+}
+
+bool shadow_volume::resolvable(const aabb& caster, int resolution) const {
+    glm::vec3 size { bounds.extent() };
+    float texel_size = glm::max(size.x, size.y) / resolution;
+
+    glm::vec3 footprint { caster.extent() };
+    return glm::max(footprint.x, footprint.y) >= SHADOW_CASTER_MIN_TEXELS * texel_size;
+}
+
+void shadow_volume::extend_toward_light(const aabb& caster) {
+    bounds.max.z = glm::max(bounds.max.z, caster.max.z);
+}
+
+glm::mat4 shadow_volume::get_matrix() const {
+    // View space z is negated in the ortho near/far distances
+    glm::mat4 light_proj { glm::ortho(bounds.min.x, bounds.max.x, bounds.min.y, bounds.max.y, -bounds.max.z, -bounds.min.z) };
+    return light_proj * light_view;
+}
+
+shadow_volume directional_light::get_shadow_volume(camera* camera, glm::mat4& camera_view, float near_z, float far_z, int resolution) {
 
-    // Get the frustum's view space corners
+    // Get the view space corners of this slice of the frustum
     float tan_half_fov = tan(glm::radians(camera->m_fov / 2));
 
-    float near_z = camera->m_near;
     float near_x = near_z * tan_half_fov;
     float near_y = near_z * tan_half_fov / camera->m_aspect;
     
-    float far_z = camera->m_shadow_range;
     float far_x = far_z * tan_half_fov;
     float far_y = far_z * tan_half_fov / camera->m_aspect;
 
@@ -108,30 +101,32 @@ glm::mat4 directional_light::get_shadow_matrix(camera* camera, glm::mat4& camera
     glm::mat4 camera_view_inv { glm::inverse(camera_view) };
     world_frustum = world_frustum.transform(camera_view_inv);
 
-    // Move the frustum to light space
-    glm::mat4 light_view = glm::lookAt(glm::vec3(0), direction, glm::vec3(0, 1, 0));
-    frustum light_frustum = world_frustum.transform(light_view);
-    
-    // Calculate the bounding box of the frustum
-    bounds b { light_frustum.bounding_box() };
+    // Fit a sphere rather than a box around the slice, so that the size of the projection
+    // doesn't change as the camera turns, and rounding the radius up keeps it stable as it moves
+    glm::vec4* corners = &world_frustum.near_bottom_left;
+    glm::vec3 centre { 0.0f };
 
-    // Calculate the light's position (still in light space, so need to convert to world space)
-    glm::vec4 light_pos { (b.min_x + b.max_x) / 2, (b.min_y + b.max_y) / 2, (b.max_z + b.min_z) / 2, 1.0f };
-    glm::mat4 light_view_inv { glm::inverse(light_view) };
-    light_pos = light_view_inv * light_pos;
+    for (int i = 0 ; i < 8 ; i += 1) centre += glm::vec3(corners[i]);
+    centre /= 8.0f;
 
-    // New light view matrix, centred at light position in world space
-    glm::mat4 final_light_view = glm::lookAt(glm::vec3(light_pos), glm::vec3(light_pos) + direction, glm::vec3(0, 1, 0));
+    float radius = 0.0f;
+    for (int i = 0 ; i < 8 ; i += 1) radius = glm::max(radius, glm::length(glm::vec3(corners[i]) - centre));
+    radius = glm::ceil(radius * 16.0f) / 16.0f;
 
-    // Transform frustum back into light space, using the new light view matrix, and calculate the orthographic projection
-    frustum final_light_frustum = world_frustum.transform(final_light_view);
-    bounds final_bounds { final_light_frustum.bounding_box() };
+    // The light view is fixed at the origin, so light space only changes when the light turns
+    glm::vec3 up { glm::abs(direction.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0) };
+    glm::mat4 light_view = glm::lookAt(glm::vec3(0), direction, up);
 
-    float padding = 1.5f;
-    glm::mat4 light_proj { glm::ortho(final_bounds.min_x * padding, final_bounds.max_x * padding, 
-                                      final_bounds.min_y * padding, final_bounds.max_y * padding,
-                                      final_bounds.min_z * padding, final_bounds.max_z * padding) };
-    
-    return light_proj * final_light_view;
-}
+    // Snap the centre to whole texels, so that moving the camera doesn't make shadow edges shimmer
+    glm::vec3 light_centre { light_view * glm::vec4(centre, 1.0f) };
+    float texel_size = 2.0f * radius / resolution;
 
+    light_centre.x = glm::floor(light_centre.x / texel_size) * texel_size;
+    light_centre.y = glm::floor(light_centre.y / texel_size) * texel_size;
+
+    shadow_volume volume {};
+    volume.light_view = light_view;
+    volume.bounds = { light_centre - glm::vec3(radius), light_centre + glm::vec3(radius) };
+
+    return volume;
+}
@@ -0,0 +1,43 @@
+#include <cmath>
+
+#include <glm/common.hpp>
+
+#include "dynamic_resolution.h"
+
+void resolution_controller::update(float frame_ms, unsigned int measured_frame, float target_ms, float min_scale) {
+    if (target_ms <= 0.0f || frame_ms <= 0.0f) {
+        m_ideal_scale = 1.0f;
+        m_scale = 1.0f;
+        return;
+    }
+
+    if (measured_frame == m_measured_frame) return;
+    m_measured_frame = measured_frame;
+
+    // Spikes are taken in quickly, and recoveries slowly
+    float blend = frame_ms > m_frame_ms ? 0.5f : 0.1f;
+    m_frame_ms = m_frame_ms == 0.0f ? frame_ms : glm::mix(m_frame_ms, frame_ms, blend);
+
+    if (m_settle > 0) {
+        m_settle -= 1;
+        return;
+    }
+
+    // GPU time mostly goes with the number of pixels drawn, so with the square of the scale
+    float wanted = m_scale * std::sqrt(target_ms / m_frame_ms);
+
+    if (wanted < m_ideal_scale) m_ideal_scale = wanted;
+    else if (m_frame_ms < target_ms * RESOLUTION_RAISE_HEADROOM) m_ideal_scale += (wanted - m_ideal_scale) * RESOLUTION_RAISE_RATE;
+
+    m_ideal_scale = glm::clamp(m_ideal_scale, glm::min(min_scale, 1.0f), 1.0f);
+
+    // Rounded down, so that the scale settles on a step that makes the target rather than flicking past it
+    float steps = std::floor(m_ideal_scale / RESOLUTION_SCALE_STEP + 0.001f);
+    float scale = glm::clamp(steps * RESOLUTION_SCALE_STEP, glm::min(min_scale, 1.0f), 1.0f);
+
+    if (scale != m_scale) {
+        m_scale = scale;
+        m_frame_ms = 0.0f;
+        m_settle = RESOLUTION_SETTLE_FRAMES;
+    }
+}
@@ -1,10 +1,21 @@
 #include <glad/glad.h>
 #include <iostream>
+#include <algorithm>
 
 #include "fbo.h"
+#include "residency.h"
 #include "utilities.h"
 
-void fbo::initialise(int pixel_width, int pixel_height, bool depth, bool color, bool set_boundaries) {
+static GLenum depth_type(GLenum depth_format) {
+    return depth_format == GL_DEPTH_COMPONENT32F ? GL_FLOAT : GL_UNSIGNED_INT;
+}
+
+// Every depth and colour format used here takes four bytes a texel, 24 bit depth included
+static std::size_t attachment_bytes(int pixel_width, int pixel_height) {
+    return static_cast<std::size_t>(pixel_width) * pixel_height * 4;
+}
+
+void fbo::initialise(int pixel_width, int pixel_height, bool depth, bool color, bool set_boundaries, GLenum depth_format) {
     m_pixel_width = pixel_width;
     m_pixel_height = pixel_height;
 
@@ -17,7 +28,7 @@ void fbo::initialise(int pixel_width, int pixel_height, bool depth, bool color,
     if (depth) {
         glGenTextures(1, &m_depth_texture);
         glBindTexture(GL_TEXTURE_2D, m_depth_texture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, pixel_width, pixel_height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        glTexImage2D(GL_TEXTURE_2D, 0, depth_format, pixel_width, pixel_height, 0, GL_DEPTH_COMPONENT, depth_type(depth_format), NULL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
@@ -33,7 +44,7 @@ void fbo::initialise(int pixel_width, int pixel_height, bool depth, bool color,
     } else {
         glGenRenderbuffers(1, &m_depth_texture);
         glBindRenderbuffer(GL_RENDERBUFFER, m_depth_texture);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, pixel_width, pixel_height);
+        glRenderbufferStorage(GL_RENDERBUFFER, depth_format, pixel_width, pixel_height);
         glBindRenderbuffer(GL_RENDERBUFFER, 0);
         glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth_texture);
     }
@@ -69,6 +80,177 @@ void fbo::initialise(int pixel_width, int pixel_height, bool depth, bool color,
     }
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    residency().track_fixed(GL_FRAMEBUFFER, m_fbo, attachment_bytes(pixel_width, pixel_height) * (color ? 2 : 1));
+}
+
+void fbo::initialise_layered(int pixel_width, int pixel_height, int layers) {
+    m_pixel_width = pixel_width;
+    m_pixel_height = pixel_height;
+
+    m_depth_attachment = true;
+    m_color_attachment = false;
+    m_depth_target = GL_TEXTURE_2D_ARRAY;
+    m_layers = layers;
+
+    glGenFramebuffers(1, &m_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+
+    glGenTextures(1, &m_depth_texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_depth_texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, pixel_width, pixel_height, layers, 0,
+                 GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+
+    GLfloat border_colour[4] { 1.0f, 1.0f, 1.0f, 1.0f };
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border_colour);
+
+    // Sampled as a shadow sampler, so that one linearly filtered fetch compares and blends four texels
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depth_texture, 0, 0);
+
+    GLenum draw_buffers[1] { GL_NONE };
+    glDrawBuffers(1, draw_buffers);
+    glReadBuffer(GL_NONE);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "An error occurred when initialising a layered frame buffer. Error code " << status << std::endl;
+        abort();
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    residency().track_fixed(GL_FRAMEBUFFER, m_fbo, attachment_bytes(pixel_width, pixel_height) * layers);
+}
+
+void fbo::initialise_targets(int pixel_width, int pixel_height, const std::vector<GLenum>& formats, GLenum depth_format) {
+    m_pixel_width = pixel_width;
+    m_pixel_height = pixel_height;
+
+    m_depth_attachment = true;
+    m_color_attachment = true;
+
+    glGenFramebuffers(1, &m_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+
+    glGenTextures(1, &m_depth_texture);
+    glBindTexture(GL_TEXTURE_2D, m_depth_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, depth_format, pixel_width, pixel_height, 0, GL_DEPTH_COMPONENT, depth_type(depth_format), NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_depth_texture, 0);
+
+    m_color_targets.resize(formats.size());
+    glGenTextures(formats.size(), &m_color_targets[0]);
+
+    std::vector<GLenum> draw_buffers {};
+
+    for (int i = 0 ; i < formats.size() ; i += 1) {
+        GLenum type = formats[i] == GL_RGB10_A2 ? GL_UNSIGNED_INT_2_10_10_10_REV : GL_UNSIGNED_BYTE;
+
+        glBindTexture(GL_TEXTURE_2D, m_color_targets[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, formats[i], pixel_width, pixel_height, 0, GL_RGBA, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, m_color_targets[i], 0);
+
+        draw_buffers.push_back(GL_COLOR_ATTACHMENT0 + i);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDrawBuffers(draw_buffers.size(), &draw_buffers[0]);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "An error occurred when initialising a multiple target frame buffer. Error code " << status << std::endl;
+        abort();
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    residency().track_fixed(GL_FRAMEBUFFER, m_fbo, attachment_bytes(pixel_width, pixel_height) * (formats.size() + 1));
+}
+
+void fbo::initialise_pyramid(int pixel_width, int pixel_height, int levels) {
+    m_pixel_width = pixel_width;
+    m_pixel_height = pixel_height;
+
+    m_depth_attachment = true;
+    m_color_attachment = false;
+    m_levels = levels;
+
+    glGenFramebuffers(1, &m_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+
+    glGenTextures(1, &m_depth_texture);
+    glBindTexture(GL_TEXTURE_2D, m_depth_texture);
+
+    for (int i = 0 ; i < levels ; i += 1) {
+        glTexImage2D(GL_TEXTURE_2D, i, GL_DEPTH_COMPONENT32F, std::max(pixel_width >> i, 1), std::max(pixel_height >> i, 1), 0,
+                     GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_depth_texture, 0);
+
+    GLenum draw_buffers[1] { GL_NONE };
+    glDrawBuffers(1, draw_buffers);
+    glReadBuffer(GL_NONE);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "An error occurred when initialising a depth pyramid's frame buffer. Error code " << status << std::endl;
+        abort();
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    std::size_t bytes { 0 };
+    for (int i = 0 ; i < levels ; i += 1) bytes += attachment_bytes(std::max(pixel_width >> i, 1), std::max(pixel_height >> i, 1));
+
+    residency().track_fixed(GL_FRAMEBUFFER, m_fbo, bytes);
+}
+
+void fbo::destroy() {
+    if (m_fbo) {
+        residency().untrack_fixed(GL_FRAMEBUFFER, m_fbo);
+        glDeleteFramebuffers(1, &m_fbo);
+    }
+
+    if (m_depth_texture) {
+        if (m_depth_attachment) glDeleteTextures(1, &m_depth_texture);
+        else glDeleteRenderbuffers(1, &m_depth_texture);
+    }
+
+    if (m_color_texture) glDeleteTextures(1, &m_color_texture);
+    if (!m_color_targets.empty()) glDeleteTextures(m_color_targets.size(), &m_color_targets[0]);
+
+    m_color_targets.clear();
+
+    m_fbo = 0;
+    m_depth_texture = 0;
+    m_color_texture = 0;
 }
 
 void fbo::bind_for_writing() {
@@ -76,12 +258,71 @@ void fbo::bind_for_writing() {
     glViewport(0, 0, m_pixel_width, m_pixel_height);
 }
 
+void fbo::bind_layer_for_writing(int layer) {
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depth_texture, 0, layer);
+    glViewport(0, 0, m_pixel_width, m_pixel_height);
+}
+
+void fbo::bind_level_for_writing(int level) {
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_depth_texture, level);
+    glViewport(0, 0, std::max(m_pixel_width >> level, 1), std::max(m_pixel_height >> level, 1));
+}
+
+void fbo::blit_layer_depth(fbo& destination, int layer) {
+    destination.bind_layer_for_writing(layer);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+    glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depth_texture, 0, layer);
+
+    glBlitFramebuffer(0, 0, m_pixel_width, m_pixel_height, 0, 0, destination.m_pixel_width, destination.m_pixel_height,
+                      GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, destination.m_fbo);
+}
+
+void fbo::blit(fbo& destination, GLbitfield buffers) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, destination.m_fbo);
+
+    glBlitFramebuffer(0, 0, m_pixel_width, m_pixel_height, 0, 0, destination.m_pixel_width, destination.m_pixel_height,
+                      buffers, GL_NEAREST);
+
+    destination.bind_for_writing();
+}
+
+void fbo::blit_to_screen(int screen_width, int screen_height) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+    bool scaled = screen_width != m_pixel_width || screen_height != m_pixel_height;
+    glBlitFramebuffer(0, 0, m_pixel_width, m_pixel_height, 0, 0, screen_width, screen_height,
+                      GL_COLOR_BUFFER_BIT, scaled ? GL_LINEAR : GL_NEAREST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, screen_width, screen_height);
+}
+
+void fbo::bind_target_for_reading(int target, GLenum texture_unit) {
+    glActiveTexture(texture_unit);
+    glBindTexture(GL_TEXTURE_2D, m_color_targets[target]);
+}
+
 void fbo::bind_depth_for_reading(GLenum texture_unit) {
     glActiveTexture(texture_unit);
-    glBindTexture(GL_TEXTURE_2D, m_depth_texture);
+    glBindTexture(m_depth_target, m_depth_texture);
 }
 
 void fbo::bind_color_for_reading(GLenum texture_unit) {
     glActiveTexture(texture_unit);
     glBindTexture(GL_TEXTURE_2D, m_color_texture);
+}
+
+void fbo::bind_levels_for_reading(int base_level, int max_level, GLenum texture_unit) {
+    glActiveTexture(texture_unit);
+    glBindTexture(GL_TEXTURE_2D, m_depth_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base_level);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, max_level);
 }
\ No newline at end of file
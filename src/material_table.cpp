@@ -0,0 +1,70 @@
+#include <iostream>
+
+#include <glad/glad.h>
+
+#include "material_table.h"
+#include "texture.h"
+#include "utilities.h"
+
+unsigned int material_table::add(const material& m) {
+    if (m_materials.size() >= MAX_MATERIALS) {
+        std::cerr << "Too many materials; at most " << MAX_MATERIALS << " can be loaded." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    m_materials.push_back(m);
+    return m_materials.size() - 1;
+}
+
+// A texture still waiting for its first mip is its own placeholder, at layer 0
+static float texture_layer(const texture* t) {
+    return t ? t->layer() : -1.0f;
+}
+
+void material_table::update() {
+    if (m_texture == 0) {
+        glGenTextures(1, &m_texture);
+        glBindTexture(GL_TEXTURE_2D, m_texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, MAX_MATERIALS, MATERIAL_TABLE_TEXELS, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        gl_error_check_barrier
+    }
+
+    int count = m_materials.size();
+    if (count == 0) return;
+
+    std::vector<glm::vec4> data(count * MATERIAL_TABLE_TEXELS);
+
+    for (int i = 0 ; i < count ; i += 1) {
+        const material& m = m_materials[i];
+
+        data[0 * count + i] = glm::vec4 { m.ambient_color, texture_layer(m.diffuse_texture) };
+        data[1 * count + i] = glm::vec4 { m.diffuse_color, texture_layer(m.specular_texture) };
+        data[2 * count + i] = glm::vec4 { m.specular_color, 0.0f };
+        float diffuse_level = m.diffuse_texture ? m.diffuse_texture->min_level() : 0;
+        float specular_level = m.specular_texture ? m.specular_texture->min_level() : 0;
+        data[3 * count + i] = glm::vec4 { diffuse_level, specular_level, 0.0f, 0.0f };
+    }
+
+    // Only changes while textures are streaming, or when a mesh is loaded
+    if (data == m_data) return;
+
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, count, MATERIAL_TABLE_TEXELS, GL_RGBA, GL_FLOAT, &data[0]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_data = std::move(data);
+}
+
+void material_table::bind(GLenum texture_unit) const {
+    glActiveTexture(texture_unit);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+}
+
+material_table& shared_materials() {
+    static material_table table {};
+    return table;
+}
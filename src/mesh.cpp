@@ -10,11 +10,13 @@
 #include "pipeline.h"
 #include "texture.h"
 #include "material.h"
+#include "material_table.h"
 #include "utilities.h"
 
 #define POSITION_LOCATION  0
 #define TEX_COORD_LOCATION 1
 #define NORMAL_LOCATION    2
+#define MATERIAL_LOCATION  3
 
 #define ASSIMP_LOAD_FLAGS (aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices)
 
@@ -69,6 +71,8 @@ void mesh::init_from_scene(const aiScene* p_scene, const std::string& file_name)
     init_materials(p_scene, file_name);
 
     populate_buffers();
+
+    build_bvh();
     
     gl_error_check_barrier
 }
@@ -91,6 +95,7 @@ void mesh::reserve_space(unsigned int num_vertices, unsigned int num_indices) {
     m_vert_positions.reserve(num_vertices);
     m_vert_texcoords.reserve(num_vertices);
     m_vert_normals.reserve(num_vertices);
+    m_vert_materials.reserve(num_vertices);
     m_indices.reserve(num_indices);
 }
 
@@ -115,14 +120,19 @@ void mesh::init_single_mesh(unsigned int mesh_index, const aiMesh* p_ai_mesh) {
         m_vert_positions.push_back(glm::vec3(p_pos.x, p_pos.y, p_pos.z));
         m_vert_texcoords.push_back(glm::vec2(p_texcoord.x, p_texcoord.y));
         m_vert_normals.push_back(glm::vec3(p_normal.x, p_normal.y, p_normal.z));
+
+        // The submesh's own material index for now; init_materials swaps it for the table's id
+        m_vert_materials.push_back(m_meshes[mesh_index].material_index);
     }
 
-    // Populate the index buffer
+    // Populate the index buffer; indices are made absolute, as GLES 3 has no base vertex draws
+    unsigned int base_vertex = m_meshes[mesh_index].base_vertex;
+
     for (unsigned int i { 0 } ; i < p_ai_mesh->mNumFaces ; i += 1) {
         const aiFace& Face = p_ai_mesh->mFaces[i];
-        m_indices.push_back(Face.mIndices[0]);
-        m_indices.push_back(Face.mIndices[1]);
-        m_indices.push_back(Face.mIndices[2]);
+        m_indices.push_back(base_vertex + Face.mIndices[0]);
+        m_indices.push_back(base_vertex + Face.mIndices[1]);
+        m_indices.push_back(base_vertex + Face.mIndices[2]);
     }
 }
 
@@ -144,7 +154,7 @@ void mesh::init_materials(const aiScene* p_scene, const std::string& file_name)
                 std::string p { path.data };
                 if (p.substr(0, 2) == ".\\") p = p.substr(2, p.size() - 2);
                 std::string full_path { dir + "/" + p };
-                m_materials[i].diffuse_texture = new texture(GL_TEXTURE_2D, full_path.c_str());                
+                m_materials[i].diffuse_texture = new texture(GL_TEXTURE_2D_ARRAY, full_path.c_str());                
                 m_materials[i].diffuse_texture->load();
             }
         }
@@ -155,7 +165,7 @@ void mesh::init_materials(const aiScene* p_scene, const std::string& file_name)
                 std::string p { path.data };
                 if (p.substr(0, 2) == ".\\") p = p.substr(2, p.size() - 2);
                 std::string full_path { dir + "/" + p };
-                m_materials[i].specular_texture = new texture(GL_TEXTURE_2D, full_path.c_str());                
+                m_materials[i].specular_texture = new texture(GL_TEXTURE_2D_ARRAY, full_path.c_str());                
                 m_materials[i].specular_texture->load();
             }
         }
@@ -184,6 +194,9 @@ void mesh::init_materials(const aiScene* p_scene, const std::string& file_name)
             m_materials[i].specular_color.b = specular_color.b;
         }
     }
+
+    for (const material& material : m_materials) m_material_ids.push_back(shared_materials().add(material));
+    for (GLuint& material : m_vert_materials) material = m_material_ids[material];
 }
 
 
@@ -206,46 +219,94 @@ void mesh::populate_buffers() {
     glEnableVertexAttribArray(NORMAL_LOCATION);
     glVertexAttribPointer(NORMAL_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
+    GLsizeiptr vert_material_bytes = sizeof(m_vert_materials[0]) * m_vert_materials.size();
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffers[V_MATERIAL_BUFFER]);
+    glBufferData(GL_ARRAY_BUFFER, vert_material_bytes, m_vert_materials.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(MATERIAL_LOCATION);
+    glVertexAttribIPointer(MATERIAL_LOCATION, 1, GL_UNSIGNED_INT, 0, 0);
+
     GLsizeiptr index_bytes = sizeof(m_indices[0]) * m_indices.size();
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buffers[INDEX_BUFFER]);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_bytes, m_indices.data(), GL_STATIC_DRAW);
 }
 
 
-void mesh::render() {
-    glBindVertexArray(m_VAO);
+void mesh::build_bvh() {
+    m_bvh.build(m_vert_positions, m_indices);
+    m_bounds = m_bvh.bounds();
+}
 
-    for (unsigned int i { 0 } ; i < m_meshes.size() ; i += 1) {
-        const unsigned int material_index = m_meshes[i].material_index;
+bool mesh::raycast(const ray& r, float& t_max, unsigned int& submesh, unsigned int& triangle) const {
+    unsigned int hit_triangle { 0 };
+    if (!m_bvh.intersect(r, t_max, hit_triangle)) return false;
 
-        assert(material_index < m_materials.size());
+    // Triangle ids run across all submeshes, in order
+    for (unsigned int i { 0 } ; i < m_meshes.size() ; i += 1) {
+        unsigned int first = m_meshes[i].base_index / 3;
+        unsigned int count = m_meshes[i].num_indices / 3;
 
-        if (m_materials[material_index].diffuse_texture) {
-            m_materials[material_index].diffuse_texture->bind(DIFFUSE_TEX_UNIT);
-        } else {
-            glActiveTexture(DIFFUSE_TEX_UNIT);
-            glBindTexture(GL_TEXTURE_2D, 0);
+        if (hit_triangle < first + count) {
+            submesh = i;
+            triangle = hit_triangle - first;
+            return true;
         }
+    }
+
+    return false;
+}
+
+
+// The array a material's texture is in; false if it's in a different one to what the draw has so far
+static bool same_array(const texture* t, GLuint& array) {
+    if (t == nullptr) return true;
+    if (array != 0 && array != t->object()) return false;
+
+    array = t->object();
+    return true;
+}
+
+void mesh::render(pipeline* p) {
+    glBindVertexArray(m_VAO);
+
+    // Colours and layers are looked up per vertex in the material table, so consecutive submeshes can be drawn at once
+    // for as long as their textures are in the same arrays
+    unsigned int i { 0 };
+
+    while (i < m_meshes.size()) {
+        GLuint diffuse { 0 };
+        GLuint specular { 0 };
+        bool specular_map { false };
+
+        unsigned int base_index = m_meshes[i].base_index;
+        unsigned int num_indices { 0 };
+
+        for ( ; i < m_meshes.size() ; i += 1) {
+            const unsigned int material_index = m_meshes[i].material_index;
+
+            assert(material_index < m_materials.size());
 
-        if (m_materials[material_index].specular_texture) {
-            m_materials[material_index].specular_texture->bind(SPECULAR_TEX_UNIT);
-        } else {
-            glActiveTexture(SPECULAR_TEX_UNIT);
-            glBindTexture(GL_TEXTURE_2D, 0);
+            const material& m = m_materials[material_index];
+            GLuint next_diffuse = diffuse;
+            GLuint next_specular = specular;
+
+            if (!same_array(m.diffuse_texture, next_diffuse) || !same_array(m.specular_texture, next_specular)) break;
+
+            diffuse = next_diffuse;
+            specular = next_specular;
+            specular_map = specular_map || m.specular_texture;
+            num_indices += m_meshes[i].num_indices;
         }
 
-        glDrawElements(GL_TRIANGLES, m_meshes[i].num_indices, GL_UNSIGNED_INT,
-                            (void*) (sizeof(m_indices[0]) * m_meshes[i].base_index));
+        if (p) p->select_material(specular_map);
+
+        glActiveTexture(DIFFUSE_TEX_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, diffuse);
+        glActiveTexture(SPECULAR_TEX_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, specular);
+
+        glDrawElements(GL_TRIANGLES, num_indices, GL_UNSIGNED_INT, (void*) (sizeof(m_indices[0]) * base_index));
     }
 
     // Make sure the VAO is not changed from the outside
     glBindVertexArray(0);
 }
-
-material& mesh::get_material() {
-    for (material& material : m_materials) {
-        if (material.ambient_color != glm::vec3 { 0, 0, 0 }) return material;
-    }
-
-    return m_materials[0];
-}
\ No newline at end of file
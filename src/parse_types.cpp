@@ -10,6 +10,7 @@
 #include "directional_light.h"
 #include "light.h"
 #include "point_light.h"
+#include "reflection_probe.h"
 #include "renderer.h"
 #include "script.h"
 #include "transform.h"
@@ -85,6 +86,21 @@ namespace serial {
             return std::nullopt;
         }
 
+        else if (type == "reflection_probe") {
+            option<reflection_probe*, error> res = deserialise_ref<reflection_probe>(arena, root, n);
+            if (std::holds_alternative<error>(res)) return std::get<error>(res);
+            reflection_probe* obj = std::get<reflection_probe*>(res);
+            sc->component_type = scene_node_type::reflection_probe;
+            sc->component = obj;
+            sc->cmp_load = [](application* app, scene* scene, scene_node* this_node) {
+                    load(app, scene, this_node, static_cast<reflection_probe*>(this_node->component)); };
+            sc->cmp_run = [](application* app, scene* scene, scene_node* this_node) {
+                    run(app, scene, this_node, static_cast<reflection_probe*>(this_node->component)); };
+            sc->cmp_render = [](application* app, scene* scene, scene_node* this_node, pipeline* p) {
+                    render(app, scene, this_node, static_cast<reflection_probe*>(this_node->component), p); };
+            return std::nullopt;
+        }
+
         else if (type == "renderer") {
             option<renderer*, error> res = deserialise_ref<renderer>(arena, root, n);
             if (std::holds_alternative<error>(res)) return std::get<error>(res);
@@ -155,6 +171,10 @@ namespace serial {
             serialise(os, *static_cast<point_light*>(sc->component), sc, indt);
         }
 
+        else if (sc->component_type == scene_node_type::reflection_probe) {
+            serialise(os, *static_cast<reflection_probe*>(sc->component), sc, indt);
+        }
+
         else if (sc->component_type == scene_node_type::renderer) {
             serialise(os, *static_cast<renderer*>(sc->component), sc, indt);
         }
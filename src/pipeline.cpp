@@ -1,6 +1,11 @@
 #include <vector>
 #include <string>
+#include <sstream>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <cstdint>
+#include <filesystem>
 
 #include <glad/glad.h>
 
@@ -8,25 +13,181 @@
 #include "pipeline.h"
 #include "point_light.h"
 #include "directional_light.h"
-#include "material.h"
+#include "reflection_probe.h"
 
-void pipeline::initialise(std::vector<shader_src> shaders, int identifier) {
+static std::string resolve_includes(const std::string& source, const std::string& file_name);
+
+void pipeline::initialise(std::vector<shader_src> shaders, int identifier, unsigned int supported_features) {
     m_identifier = identifier;
-    m_program = glCreateProgram();
+    m_shaders = shaders;
+    m_supported_features = supported_features;
+
+    m_sources.clear();
+    m_variants.clear();
+    m_values.assign(UNIFORM_COUNT, {});
+
+    // Sources are kept so that further variants can be compiled as they're needed
+    for (shader_src src : shaders) m_sources.push_back(resolve_includes(load_from_file(src.file_name), src.file_name));
+
+    // Pipelines with features have their likely variants prepared by their users instead
+    if (supported_features == 0) prepare(0);
+}
+
+void pipeline::enable(unsigned int features) {
+    for (uniform_value& value : m_values) value.kind = uniform_value::NONE;
+
+    use_variant(features);
+}
 
-    for (shader_src src : shaders) add_shader(src.type, src.file_name);
+void pipeline::select_material(bool specular_map) {
+    if (!(m_supported_features & PIPELINE_FEATURE_SPECULAR_MAP)) return;
 
-    finalise();
+    unsigned int features = m_features & ~PIPELINE_FEATURE_SPECULAR_MAP;
+    if (specular_map) features |= PIPELINE_FEATURE_SPECULAR_MAP;
+
+    if (features == m_features) return;
+
+    use_variant(features);
+    replay_uniforms();
 }
 
-void pipeline::enable() {
+void pipeline::use_variant(unsigned int features) {
+    features &= m_supported_features;
+
+    prepare(features);
+
+    variant& v = m_variants[features];
+    finish_variant(v);
+
+    m_features = features;
+    m_variant = &v;
+    m_program = v.program;
+
     glUseProgram(m_program);
 }
 
-void pipeline::add_shader(GLuint type, std::string file_name) {
+// Replace lines of the form #include "file" with that file's contents, found relative to the including file
+static std::string resolve_includes(const std::string& source, const std::string& file_name) {
+    std::string directory { file_name.substr(0, file_name.find_last_of('/') + 1) };
+
+    std::istringstream in { source };
+    std::string result {};
+    std::string line {};
+
+    while (std::getline(in, line)) {
+        if (line.rfind("#include \"", 0) == 0) {
+            std::size_t start = line.find('"') + 1;
+            std::string included { directory + line.substr(start, line.find('"', start) - start) };
+
+            result.append(resolve_includes(load_from_file(included), included));
+        } else {
+            result.append(line).append("\n");
+        }
+    }
+
+    return result;
+}
+
+// The #version line has to come first, so the feature defines go straight after it
+static std::string inject_defines(const std::string& source, unsigned int features, unsigned int supported_features) {
+    std::string defines {};
+
+    if (features & PIPELINE_FEATURE_SHADOWS) defines.append("#define SHADOWS\n");
+    if (features & PIPELINE_FEATURE_POINT_LIGHTS) defines.append("#define POINT_LIGHTS\n");
+    if (features & PIPELINE_FEATURE_SPECULAR_MAP) defines.append("#define SPECULAR_MAP\n");
+    if (features & PIPELINE_FEATURE_REFLECTION) defines.append("#define REFLECTION\n");
+
+    if (supported_features & PIPELINE_FEATURE_PCF_MASK) {
+        unsigned int kernel = (features & PIPELINE_FEATURE_PCF_MASK) >> PIPELINE_FEATURE_PCF_SHIFT;
+        defines.append("#define PCF_KERNEL ").append(std::to_string(kernel)).append("\n");
+    }
+
+    std::size_t first_line = source.find('\n') + 1;
+
+    return source.substr(0, first_line) + defines + source.substr(first_line);
+}
+
+// FNV-1a, over the sources of every stage and the driver that will compile them
+static std::string program_hash(const std::vector<std::string>& sources) {
+    std::uint64_t hash { 14695981039346656037ull };
 
-    const std::string source { load_from_file(file_name) };
+    auto add = [&hash](const char* data) {
+        for ( ; data && *data ; data += 1) {
+            hash ^= static_cast<unsigned char>(*data);
+            hash *= 1099511628211ull;
+        }
+    };
 
+    add(reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+    add(reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+    add(reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+
+    for (const std::string& source : sources) add(source.c_str());
+
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+
+    return name;
+}
+
+void pipeline::prepare(unsigned int features) {
+    features &= m_supported_features;
+
+    variant& v = m_variants[features];
+    if (v.program != 0) return;
+
+    v.locations.assign(UNIFORM_COUNT, -2);
+
+    std::vector<std::string> sources {};
+    for (const std::string& source : m_sources) sources.push_back(inject_defines(source, features, m_supported_features));
+
+    if (gl_has_program_binary()) {
+        v.cache_file = SHADER_CACHE_DIRECTORY + program_hash(sources) + ".bin";
+        if (load_binary(v)) return;
+    }
+
+    v.program = glCreateProgram();
+
+    for (int i = 0 ; i < m_shaders.size() ; i += 1) {
+        v.shaders.push_back(add_shader(v.program, m_shaders[i].type, sources[i]));
+    }
+
+#ifndef __EMSCRIPTEN__
+    if (gl_has_program_binary()) glProgramParameteri(v.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+
+    // Nothing is queried here, so that with parallel compilation every program builds at once
+    glLinkProgram(v.program);
+    v.pending = true;
+}
+
+// Compiling and linking are checked on the first use, which is where any wait for the driver happens
+void pipeline::finish_variant(variant& v) {
+    if (!v.pending) return;
+    v.pending = false;
+
+    GLint status {};
+    glGetProgramiv(v.program, GL_LINK_STATUS, &status);
+
+    for (int i = 0 ; i < v.shaders.size() ; i += 1) check_shader(v.shaders[i], m_shaders[i].type, m_shaders[i].file_name);
+
+    if (status == GL_FALSE) {
+        std::cerr << "Fatal: Graphics pipeline failed to be established; the program object was invalid." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // Clean up shader programs
+    for (GLuint shader : v.shaders) {
+        glDetachShader(v.program, shader);
+        glDeleteShader(shader);
+    }
+
+    v.shaders.clear();
+
+    if (!v.cache_file.empty()) save_binary(v);
+}
+
+GLuint pipeline::add_shader(GLuint program, GLuint type, const std::string& source) {
     GLuint shader_object {};
 
     // Make sure the shader is of an expected type
@@ -43,15 +204,22 @@ void pipeline::add_shader(GLuint type, std::string file_name) {
     glShaderSource(shader_object, 1, &source_array, nullptr);
     glCompileShader(shader_object);
 
+    glAttachShader(program, shader_object);
+
+    return shader_object;
+}
+
+void pipeline::check_shader(GLuint shader, GLuint type, const std::string& file_name) {
+
     // Handle compilation errors
     GLint status {};
-    glGetShaderiv(shader_object, GL_COMPILE_STATUS, &status);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
 
     if (status == GL_FALSE) {
         GLint length;
-        glGetShaderiv(shader_object, GL_INFO_LOG_LENGTH, &length);
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
         char* error_msg = new char[length];
-        glGetShaderInfoLog(shader_object, length, &length, error_msg);
+        glGetShaderInfoLog(shader, length, &length, error_msg);
         
         std::string shader_type = type == GL_VERTEX_SHADER ? "vertex" : "fragment";
 
@@ -59,47 +227,130 @@ void pipeline::add_shader(GLuint type, std::string file_name) {
         std::cerr << "Message:   " << error_msg << std::endl;
         exit(EXIT_FAILURE);
     }
+}
+
+// Binaries are stored as their format followed by the data. A driver update or a change to any source gives a
+// different file name, but a driver can still refuse a binary, in which case the program is built from source.
+bool pipeline::load_binary(variant& v) {
+#ifdef __EMSCRIPTEN__
+    return false;
+#else
+    std::ifstream file { v.cache_file, std::ios::binary };
+    if (!file.is_open()) return false;
+
+    GLenum format {};
+    file.read(reinterpret_cast<char*>(&format), sizeof(format));
+
+    std::vector<char> binary { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+    if (binary.empty()) return false;
+
+    v.program = glCreateProgram();
+    glProgramBinary(v.program, format, &binary[0], binary.size());
+
+    GLint status {};
+    glGetProgramiv(v.program, GL_LINK_STATUS, &status);
+
+    if (status == GL_FALSE) {
+        glDeleteProgram(v.program);
+        v.program = 0;
+        return false;
+    }
+
+    return true;
+#endif
+}
+
+void pipeline::save_binary(variant& v) {
+#ifndef __EMSCRIPTEN__
+    GLint length {};
+    glGetProgramiv(v.program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<char> binary(length);
+    GLenum format {};
+    glGetProgramBinary(v.program, length, &length, &format, &binary[0]);
+
+    std::error_code error {};
+    std::filesystem::create_directories(SHADER_CACHE_DIRECTORY, error);
+
+    std::ofstream file { v.cache_file, std::ios::binary };
+
+    if (!file.is_open()) {
+        std::cerr << "Warning: unable to write the shader cache \"" << v.cache_file << "\"." << std::endl;
+        return;
+    }
 
-    glAttachShader(m_program, shader_object);
+    file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+    file.write(&binary[0], length);
+#endif
+}
 
-    m_temp_shader_handles.push_back(shader_object);
+static const char* uniform_name(pipeline::uniform u) {
+    switch (u) {
+        case pipeline::UNIFORM_MODEL_MAT: return "u_model_matrix";
+        case pipeline::UNIFORM_VIEW_MAT: return "u_view_matrix";
+        case pipeline::UNIFORM_PROJ_MAT: return "u_proj_matrix";
+        case pipeline::UNIFORM_INV_VIEW_MAT: return "u_inv_view_matrix";
+        case pipeline::UNIFORM_SHADOW0_MAT: return "u_shadow_matrix";
+        case pipeline::UNIFORM_SHADOW_MATS: return "u_shadow_matrices";
+        case pipeline::UNIFORM_CASCADE_SPLITS: return "u_cascade_splits";
+        case pipeline::UNIFORM_NUM_CASCADES: return "u_num_cascades";
+        case pipeline::UNIFORM_SHADOW_TEXEL_SIZE: return "u_shadow_texel_size";
+
+        case pipeline::UNIFORM_SAMPLER_DIFFUSE: return "u_sampler_diffuse";
+        case pipeline::UNIFORM_SAMPLER_SPECULAR: return "u_sampler_specular";
+        case pipeline::UNIFORM_SAMPLER_DEPTH0: return "u_sampler_depth0";
+        case pipeline::UNIFORM_SAMPLER_SHADOW: return "u_sampler_shadow";
+        case pipeline::UNIFORM_SAMPLER_NOISE: return "u_sampler_noise";
+        case pipeline::UNIFORM_SAMPLER_DUDV: return "u_sampler_dudv";
+        case pipeline::UNIFORM_SAMPLER_REFLECTION: return "u_sampler_reflection";
+        case pipeline::UNIFORM_SAMPLER_REFRACTION: return "u_sampler_refraction";
+        case pipeline::UNIFORM_SAMPLER_NORMAL: return "u_sampler_normal";
+        case pipeline::UNIFORM_SAMPLER_GBUFFER_AMBIENT: return "u_sampler_gbuffer_ambient";
+        case pipeline::UNIFORM_SAMPLER_GBUFFER_DIFFUSE: return "u_sampler_gbuffer_diffuse";
+        case pipeline::UNIFORM_SAMPLER_GBUFFER_SPECULAR: return "u_sampler_gbuffer_specular";
+        case pipeline::UNIFORM_SAMPLER_GBUFFER_NORMAL: return "u_sampler_gbuffer_normal";
+        case pipeline::UNIFORM_SAMPLER_LIGHTS: return "u_sampler_lights";
+        case pipeline::UNIFORM_SAMPLER_CLUSTERS: return "u_sampler_clusters";
+        case pipeline::UNIFORM_SAMPLER_LIGHT_INDICES: return "u_sampler_light_indices";
+        case pipeline::UNIFORM_SAMPLER_DEPTH_PYRAMID: return "u_sampler_depth_pyramid";
+        case pipeline::UNIFORM_SAMPLER_PROBE0: return "u_sampler_probe0";
+        case pipeline::UNIFORM_SAMPLER_PROBE1: return "u_sampler_probe1";
+        case pipeline::UNIFORM_SAMPLER_MATERIALS: return "u_sampler_materials";
+        case pipeline::UNIFORM_SAMPLER_COLOR: return "u_sampler_color";
+        case pipeline::UNIFORM_DEPTH_PYRAMID_LEVELS: return "u_depth_pyramid_levels";
+        case pipeline::UNIFORM_CLUSTER_DEPTH: return "u_cluster_depth";
+
+        case pipeline::UNIFORM_TIME: return "u_time";
+
+        case pipeline::UNIFORM_CAMERA_POS: return "u_camera_pos";
+        case pipeline::UNIFORM_CAMERA_NEAR: return "u_cam_near";
+        case pipeline::UNIFORM_CAMERA_FAR: return "u_cam_far";
+
+        case pipeline::UNIFORM_REFRACTION_DEPTH: return "u_refraction_depth";
+        case pipeline::UNIFORM_REFLECTION_MAT: return "u_reflection_matrix";
+        case pipeline::UNIFORM_REFLECTION_MODE: return "u_reflection_mode";
+        case pipeline::UNIFORM_REFLECTION_DISTANCE: return "u_reflection_distance";
+        case pipeline::UNIFORM_SKY_COLOR: return "u_sky_color";
+
+        default: return nullptr;
+    }
 }
 
+// Locations are only looked up once per variant; -2 marks one that hasn't been yet
 GLint pipeline::get_uniform_location(uniform u) {
-    GLint loc { -1 };
-
-    if (u == UNIFORM_MODEL_MAT) loc = glGetUniformLocation(m_program, "u_model_matrix");
-    else if (u == UNIFORM_VIEW_MAT) loc = glGetUniformLocation(m_program, "u_view_matrix");
-    else if (u == UNIFORM_PROJ_MAT) loc = glGetUniformLocation(m_program, "u_proj_matrix");
-    else if (u == UNIFORM_SHADOW0_MAT) loc = glGetUniformLocation(m_program, "u_shadow_matrix");
-
-    else if (u == UNIFORM_SAMPLER_DIFFUSE) loc = glGetUniformLocation(m_program, "u_sampler_diffuse");
-    else if (u == UNIFORM_SAMPLER_SPECULAR) loc = glGetUniformLocation(m_program, "u_sampler_specular");
-    else if (u == UNIFORM_SAMPLER_DEPTH0) loc = glGetUniformLocation(m_program, "u_sampler_depth0");
-    else if (u == UNIFORM_SAMPLER_NOISE) loc = glGetUniformLocation(m_program, "u_sampler_noise");
-    else if (u == UNIFORM_SAMPLER_DUDV) loc = glGetUniformLocation(m_program, "u_sampler_dudv");
-    else if (u == UNIFORM_SAMPLER_REFLECTION) loc = glGetUniformLocation(m_program, "u_sampler_reflection");
-    else if (u == UNIFORM_SAMPLER_REFRACTION) loc = glGetUniformLocation(m_program, "u_sampler_refraction");
-    else if (u == UNIFORM_SAMPLER_NORMAL) loc = glGetUniformLocation(m_program, "u_sampler_normal");
-    
-    else if (u == UNIFORM_MATERIAL__AMBIENT_COLOR) loc = glGetUniformLocation(m_program, "u_material.ambient_color");
-    else if (u == UNIFORM_MATERIAL__DIFFUSE_COLOR) loc = glGetUniformLocation(m_program, "u_material.diffuse_color");
-    else if (u == UNIFORM_MATERIAL__SPECULAR_COLOR) loc = glGetUniformLocation(m_program, "u_material.specular_color");
-
-    else if (u == UNIFORM_TIME) loc = glGetUniformLocation(m_program, "u_time");
-
-    else if (u == UNIFORM_CAMERA_POS) loc = glGetUniformLocation(m_program, "u_camera_pos");
-    else if (u == UNIFORM_CAMERA_NEAR) loc = glGetUniformLocation(m_program, "u_cam_near");
-    else if (u == UNIFORM_CAMERA_FAR) loc = glGetUniformLocation(m_program, "u_cam_far");
-
-    else if (u == UNIFORM_CLIP_PLANE) loc = glGetUniformLocation(m_program, "u_clip_plane");
-    else if (u == UNIFORM_CLIP_ENABLED) loc = glGetUniformLocation(m_program, "u_clip_enabled");
+    GLint& loc = m_variant->locations[u];
+    if (loc != -2) return loc;
 
-    else {
+    const char* name = uniform_name(u);
+
+    if (name == nullptr) {
         std::cerr << "Error - unhandled uniform variant, with code " << u << std::endl;
         exit(EXIT_FAILURE);
     }
 
+    loc = glGetUniformLocation(m_program, name);
+
     // if (loc == -1) {
     //     std::cerr << "Warning - unable to find uniform with code " << u << " - it may have been misspelled, or optimised out.\n";
     // }
@@ -107,108 +358,145 @@ GLint pipeline::get_uniform_location(uniform u) {
     return loc;
 }
 
+GLint pipeline::get_uniform_location(const char* name) {
+    auto found = m_variant->named_locations.find(name);
+    if (found != m_variant->named_locations.end()) return found->second;
+
+    GLint loc = glGetUniformLocation(m_program, name);
+    m_variant->named_locations.emplace(name, loc);
+
+    return loc;
+}
+
+// Every uniform set since the last enable, set again on the variant now in use
+void pipeline::replay_uniforms() {
+    for (int i = 0 ; i < m_values.size() ; i += 1) {
+        uniform u = static_cast<uniform>(i);
+        uniform_value value = m_values[i];
+
+        if (value.kind == uniform_value::MATRIX) set_uniform(u, value.matrix);
+        else if (value.kind == uniform_value::MATRICES) set_uniform(u, value.matrices);
+        else if (value.kind == uniform_value::FLOATS) set_uniform(u, value.floats);
+        else if (value.kind == uniform_value::INT) set_uniform(u, value.i);
+        else if (value.kind == uniform_value::FLOAT) set_uniform(u, value.f);
+        else if (value.kind == uniform_value::VEC2) set_uniform(u, glm::vec2 { value.vector });
+        else if (value.kind == uniform_value::VEC3) set_uniform(u, glm::vec3 { value.vector });
+        else if (value.kind == uniform_value::VEC4) set_uniform(u, value.vector);
+        else if (value.kind == uniform_value::DIR_LIGHTS) set_uniform(u, value.lights);
+        else if (value.kind == uniform_value::PROBES) set_uniform(u, value.probes);
+    }
+}
+
 void pipeline::set_uniform(uniform u, glm::mat4& matrix) {
+    m_values[u].kind = uniform_value::MATRIX;
+    m_values[u].matrix = matrix;
+
     glUniformMatrix4fv(get_uniform_location(u), 1, GL_FALSE, &matrix[0][0]);
 }
 
+void pipeline::set_uniform(uniform u, std::vector<glm::mat4>& matrices) {
+    if (matrices.empty()) return;
+
+    m_values[u].kind = uniform_value::MATRICES;
+    m_values[u].matrices = matrices;
+
+    glUniformMatrix4fv(get_uniform_location(u), matrices.size(), GL_FALSE, &matrices[0][0][0]);
+}
+
+void pipeline::set_uniform(uniform u, std::vector<float>& inputs) {
+    if (inputs.empty()) return;
+
+    m_values[u].kind = uniform_value::FLOATS;
+    m_values[u].floats = inputs;
+
+    glUniform1fv(get_uniform_location(u), inputs.size(), &inputs[0]);
+}
+
 void pipeline::set_uniform(uniform u, int input) {
+    m_values[u].kind = uniform_value::INT;
+    m_values[u].i = input;
+
     glUniform1i(get_uniform_location(u), input);
 }
 
 void pipeline::set_uniform(uniform u, float input) {
+    m_values[u].kind = uniform_value::FLOAT;
+    m_values[u].f = input;
+
     glUniform1f(get_uniform_location(u), input);
 }
 
 void pipeline::set_uniform(uniform u, std::vector<directional_light*> lights) {
     if (u != UNIFORM_DIR_LIGHTS) return;
 
+    m_values[u].kind = uniform_value::DIR_LIGHTS;
+    m_values[u].lights = lights;
+
     // How many directional lights in the vector?
-    glUniform1i(glGetUniformLocation(m_program, "u_num_dir_lights"), lights.size());
+    glUniform1i(get_uniform_location("u_num_dir_lights"), lights.size());
 
     for (int i = 0 ; i < lights.size() ; i += 1) {
-        GLint loc { -1 };
         char name[128];
 
         // Base light fields
         snprintf(name, sizeof(name), "u_dir_lights[%d].base.color", i);
-        glUniform3fv(glGetUniformLocation(m_program, name), 1, &lights[i]->base.color[0]);
+        glUniform3fv(get_uniform_location(name), 1, &lights[i]->base.color[0]);
         snprintf(name, sizeof(name), "u_dir_lights[%d].base.ambient_intensity", i);
-        glUniform1f(glGetUniformLocation(m_program, name), lights[i]->base.ambient_intensity);
+        glUniform1f(get_uniform_location(name), lights[i]->base.ambient_intensity);
         snprintf(name, sizeof(name), "u_dir_lights[%d].base.diffuse_intensity", i);
-        glUniform1f(glGetUniformLocation(m_program, name), lights[i]->base.diffuse_intensity);
+        glUniform1f(get_uniform_location(name), lights[i]->base.diffuse_intensity);
         snprintf(name, sizeof(name), "u_dir_lights[%d].base.specular_intensity", i);
-        glUniform1f(glGetUniformLocation(m_program, name), lights[i]->base.specular_intensity);
+        glUniform1f(get_uniform_location(name), lights[i]->base.specular_intensity);
 
         // Directional light fields
         snprintf(name, sizeof(name), "u_dir_lights[%d].direction", i);
-        glUniform3fv(glGetUniformLocation(m_program, name), 1, &lights[i]->direction[0]);
+        glUniform3fv(get_uniform_location(name), 1, &lights[i]->direction[0]);
     }
 }
 
-void pipeline::set_uniform(uniform u, std::vector<point_light*> lights) {
-    if (u != UNIFORM_POINT_LIGHTS) return;
+void pipeline::set_uniform(uniform u, std::vector<reflection_probe*> probes) {
+    if (u != UNIFORM_REFLECTION_PROBES) return;
 
-    // How many points lights in the vector?
-    glUniform1i(glGetUniformLocation(m_program, "u_num_point_lights"), lights.size());
+    m_values[u].kind = uniform_value::PROBES;
+    m_values[u].probes = probes;
 
-    for (int i = 0 ; i < lights.size() ; i += 1) {
-        GLint loc { -1 };
+    glUniform1i(get_uniform_location("u_num_probes"), probes.size());
+
+    for (int i = 0 ; i < probes.size() ; i += 1) {
         char name[128];
 
-        // Base light fields
-        snprintf(name, sizeof(name), "u_point_lights[%d].base.color", i);
-        glUniform3fv(glGetUniformLocation(m_program, name), 1, &lights[i]->base.color[0]);
-        snprintf(name, sizeof(name), "u_point_lights[%d].base.ambient_intensity", i);
-        glUniform1f(glGetUniformLocation(m_program, name), lights[i]->base.ambient_intensity);
-        snprintf(name, sizeof(name), "u_point_lights[%d].base.diffuse_intensity", i);
-        glUniform1f(glGetUniformLocation(m_program, name), lights[i]->base.diffuse_intensity);
-        snprintf(name, sizeof(name), "u_point_lights[%d].base.specular_intensity", i);
-        glUniform1f(glGetUniformLocation(m_program, name), lights[i]->base.specular_intensity);
-
-        // Point light fields
-        snprintf(name, sizeof(name), "u_point_lights[%d].world_pos", i);
-        glUniform3fv(glGetUniformLocation(m_program, name), 1, &lights[i]->transform.pos[0]);
-        snprintf(name, sizeof(name), "u_point_lights[%d].attn_const", i);
-        glUniform1f(glGetUniformLocation(m_program, name), lights[i]->attn_const);
-        snprintf(name, sizeof(name), "u_point_lights[%d].attn_linear", i);
-        glUniform1f(glGetUniformLocation(m_program, name), lights[i]->attn_linear);
-        snprintf(name, sizeof(name), "u_point_lights[%d].attn_exp", i);
-        glUniform1f(glGetUniformLocation(m_program, name), lights[i]->attn_exp);
+        // The box proxy is given relative to the probe, but the shader wants it in world space
+        glm::vec3 box_min { probes[i]->position + probes[i]->box_min };
+        glm::vec3 box_max { probes[i]->position + probes[i]->box_max };
+
+        snprintf(name, sizeof(name), "u_probes[%d].position", i);
+        glUniform3fv(get_uniform_location(name), 1, &probes[i]->position[0]);
+        snprintf(name, sizeof(name), "u_probes[%d].box_min", i);
+        glUniform3fv(get_uniform_location(name), 1, &box_min[0]);
+        snprintf(name, sizeof(name), "u_probes[%d].box_max", i);
+        glUniform3fv(get_uniform_location(name), 1, &box_max[0]);
+        snprintf(name, sizeof(name), "u_probes[%d].radius", i);
+        glUniform1f(get_uniform_location(name), probes[i]->radius);
     }
 }
 
-void pipeline::set_uniform(uniform u, material& material) {
-    if (u != UNIFORM_MATERIAL) return;
+void pipeline::set_uniform(uniform u, glm::vec2 vector) {
+    m_values[u].kind = uniform_value::VEC2;
+    m_values[u].vector = glm::vec4 { vector, 0.0f, 0.0f };
 
-    glUniform3fv(get_uniform_location(UNIFORM_MATERIAL__AMBIENT_COLOR), 1, &material.ambient_color[0]);
-    glUniform3fv(get_uniform_location(UNIFORM_MATERIAL__DIFFUSE_COLOR), 1, &material.diffuse_color[0]);
-    glUniform3fv(get_uniform_location(UNIFORM_MATERIAL__SPECULAR_COLOR), 1, &material.specular_color[0]);
+    glUniform2fv(get_uniform_location(u), 1, &vector[0]);
 }
 
 void pipeline::set_uniform(uniform u, glm::vec3 vector) {
+    m_values[u].kind = uniform_value::VEC3;
+    m_values[u].vector = glm::vec4 { vector, 0.0f };
+
     glUniform3fv(get_uniform_location(u), 1, &vector[0]);
 }
 
 void pipeline::set_uniform(uniform u, glm::vec4 vector) {
-    glUniform4fv(get_uniform_location(u), 1, &vector[0]);
-}
-
-void pipeline::finalise() {
-    glLinkProgram(m_program);
+    m_values[u].kind = uniform_value::VEC4;
+    m_values[u].vector = vector;
 
-    // Handle linking errors
-    GLint status {};
-    glValidateProgram(m_program);
-    glGetProgramiv(m_program, GL_VALIDATE_STATUS, &status);
-
-    if (status == GL_FALSE) {
-        std::cerr << "Fatal: Graphics pipeline failed to be established; the program object was invalid." << std::endl;
-        exit(EXIT_FAILURE);
-    }
-
-    // Clean up shader programs
-    for (GLuint shader : m_temp_shader_handles) {
-        glDetachShader(m_program, shader);
-        glDeleteShader(shader);
-    }
+    glUniform4fv(get_uniform_location(u), 1, &vector[0]);
 }
@@ -0,0 +1,172 @@
+#include <iostream>
+#include <iomanip>
+
+#include <glm/common.hpp>
+
+#include "profiler.h"
+
+static float milliseconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void gpu_profiler::initialise() {
+#ifndef __EMSCRIPTEN__
+    // Some drivers expose the query, but with a counter that doesn't count
+    GLint bits = 0;
+    glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+    m_gpu_timing = bits > 0;
+#endif
+}
+
+void gpu_profiler::begin_frame(unsigned int frame) {
+
+    // Oldest first; once one isn't finished, none of the later ones are either
+    for (int i = 0 ; i < PROFILER_FRAMES ; i += 1) {
+        frame_slot& slot = m_slots[(m_slot + i) % PROFILER_FRAMES];
+        if (slot.pending && !collect(slot)) break;
+    }
+
+    // A frame the GPU still hasn't finished is dropped; its queries are simply issued again
+    frame_slot& slot = m_slots[m_slot];
+    slot.pending = false;
+    slot.frame = frame;
+    slot.queries_used = 0;
+    slot.passes.clear();
+
+    m_in_frame = true;
+    m_frame_start = clock::now();
+
+    timestamp(slot);
+}
+
+void gpu_profiler::end_frame() {
+    if (!m_in_frame) return;
+
+    frame_slot& slot = m_slots[m_slot];
+    slot.cpu_ms = milliseconds_since(m_frame_start);
+    slot.pending = true;
+
+    m_in_frame = false;
+    m_slot = (m_slot + 1) % PROFILER_FRAMES;
+
+    // Without GPU timing there's nothing to wait for
+    if (!m_gpu_timing) collect(slot);
+}
+
+void gpu_profiler::begin_pass(const std::string& name) {
+    if (!m_in_frame) return;
+
+    m_slots[m_slot].passes.push_back({ name });
+    m_pass_start = clock::now();
+}
+
+void gpu_profiler::end_pass() {
+    if (!m_in_frame) return;
+
+    frame_slot& slot = m_slots[m_slot];
+    slot.passes.back().cpu_ms = milliseconds_since(m_pass_start);
+
+    timestamp(slot);
+}
+
+void gpu_profiler::set_log(const std::string& path) {
+    if (path == m_log_path) return;
+
+    m_log_path = path;
+    if (m_log.is_open()) m_log.close();
+    if (path.empty()) return;
+
+    m_log.open(path, std::ios::out | std::ios::app);
+
+    if (!m_log.is_open()) std::cerr << "Warning: could not open the profiler log " << path << std::endl;
+}
+
+bool gpu_profiler::collect(frame_slot& slot) {
+    float gpu_ms = 0.0f;
+
+#ifndef __EMSCRIPTEN__
+    if (m_gpu_timing && slot.queries_used > 0) {
+
+        // Timestamps are written in order, so the frame is done once its last one is
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(slot.queries[slot.queries_used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available == GL_FALSE) return false;
+
+        std::vector<GLuint64> stamps(slot.queries_used);
+        for (int i = 0 ; i < slot.queries_used ; i += 1) glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &stamps[i]);
+
+        for (int i = 0 ; i < slot.passes.size() && i + 1 < slot.queries_used ; i += 1) {
+            slot.passes[i].gpu_ms = (stamps[i + 1] - stamps[i]) / 1000000.0f;
+        }
+
+        gpu_ms = (stamps.back() - stamps.front()) / 1000000.0f;
+    }
+#endif
+
+    slot.pending = false;
+
+    // Passes start from their first measurement, and the smoothed list follows whichever passes ran
+    m_timings.clear();
+
+    for (const timing& t : slot.passes) {
+        auto [it, added] = m_smoothed.try_emplace(t.name, t);
+
+        if (!added) {
+            it->second.gpu_ms = glm::mix(it->second.gpu_ms, t.gpu_ms, PROFILER_SMOOTHING);
+            it->second.cpu_ms = glm::mix(it->second.cpu_ms, t.cpu_ms, PROFILER_SMOOTHING);
+        }
+
+        m_timings.push_back(it->second);
+    }
+
+    bool first = !m_measured;
+    m_measured = true;
+    m_frame.gpu_ms = first ? gpu_ms : glm::mix(m_frame.gpu_ms, gpu_ms, PROFILER_SMOOTHING);
+    m_frame.cpu_ms = first ? slot.cpu_ms : glm::mix(m_frame.cpu_ms, slot.cpu_ms, PROFILER_SMOOTHING);
+
+    m_last_frame_gpu_ms = gpu_ms;
+    m_last_frame = slot.frame;
+
+    write_log(slot, gpu_ms);
+
+    return true;
+}
+
+void gpu_profiler::timestamp(frame_slot& slot) {
+#ifndef __EMSCRIPTEN__
+    if (!m_gpu_timing) return;
+
+    if (slot.queries_used == slot.queries.size()) {
+        GLuint query = 0;
+        glGenQueries(1, &query);
+        slot.queries.push_back(query);
+    }
+
+    glQueryCounter(slot.queries[slot.queries_used], GL_TIMESTAMP);
+    slot.queries_used += 1;
+#endif
+}
+
+void gpu_profiler::write_log(const frame_slot& slot, float gpu_ms) {
+    if (!m_log.is_open()) return;
+
+    // GPU times are null where they couldn't be measured, rather than a misleading zero
+    auto gpu = [this](float ms) -> std::ostream& {
+        if (m_gpu_timing) m_log << ms;
+        else m_log << "null";
+        return m_log;
+    };
+
+    m_log << std::fixed << std::setprecision(3);
+    m_log << "{\"frame\": " << slot.frame << ", \"gpu_ms\": ";
+    gpu(gpu_ms) << ", \"cpu_ms\": " << slot.cpu_ms << ", \"passes\": [";
+
+    for (int i = 0 ; i < slot.passes.size() ; i += 1) {
+        const timing& t = slot.passes[i];
+
+        m_log << (i == 0 ? "" : ", ") << "{\"name\": \"" << t.name << "\", \"gpu_ms\": ";
+        gpu(t.gpu_ms) << ", \"cpu_ms\": " << t.cpu_ms << "}";
+    }
+
+    m_log << "]}\n";
+}
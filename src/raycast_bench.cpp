@@ -0,0 +1,147 @@
+#include <vector>
+#include <string>
+#include <iostream>
+#include <chrono>
+#include <random>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+
+#include "bvh.h"
+#include "workers.h"
+
+// Offline raycast benchmark. Every model given is loaded without a GL context, its triangle BVH built as
+// mesh::load builds it, and then hit with a fixed set of random rays, each aimed from a sphere around the model
+// at a point inside its bounds, so that they're as incoherent as picking and line of sight checks get:
+//  - one at a time on this thread, the way scene::raycast traces
+//  - in parallel over the worker pool, the way scene::raycast_many does
+// Throughput is reported in millions of rays per second.
+
+#define BENCH_RAYS 1000000
+#define BENCH_PASSES 5
+
+#define ASSIMP_LOAD_FLAGS (aiProcess_Triangulate | aiProcess_JoinIdenticalVertices)
+
+void error(std::string message) {
+    std::cout << message << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+// Every submesh's triangles in one list, with absolute indices, as mesh::init_single_mesh lays them out
+static void load_triangles(const std::string& file_name, std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices) {
+    Assimp::Importer importer {};
+    const aiScene* p_scene = importer.ReadFile(file_name, ASSIMP_LOAD_FLAGS);
+
+    if (!p_scene) error("Unable to read \"" + file_name + "\": " + importer.GetErrorString());
+
+    for (unsigned int i = 0 ; i < p_scene->mNumMeshes ; i += 1) {
+        const aiMesh* p_ai_mesh = p_scene->mMeshes[i];
+        unsigned int base_vertex = positions.size();
+
+        for (unsigned int v = 0 ; v < p_ai_mesh->mNumVertices ; v += 1) {
+            const aiVector3D& p_pos = p_ai_mesh->mVertices[v];
+            positions.push_back(glm::vec3(p_pos.x, p_pos.y, p_pos.z));
+        }
+
+        for (unsigned int f = 0 ; f < p_ai_mesh->mNumFaces ; f += 1) {
+            const aiFace& face = p_ai_mesh->mFaces[f];
+            if (face.mNumIndices != 3) continue;
+
+            for (unsigned int k = 0 ; k < 3 ; k += 1) indices.push_back(base_vertex + face.mIndices[k]);
+        }
+    }
+}
+
+static std::vector<ray> make_rays(const aabb& bounds, unsigned int count) {
+    std::mt19937 rng { 1234 };
+    std::uniform_real_distribution<float> unit { 0.0f, 1.0f };
+    std::normal_distribution<float> normal { 0.0f, 1.0f };
+
+    float radius = glm::length(bounds.extent());
+    std::vector<ray> rays(count);
+
+    for (ray& r : rays) {
+        glm::vec3 target = bounds.min + bounds.extent() * glm::vec3 { unit(rng), unit(rng), unit(rng) };
+        glm::vec3 side = glm::normalize(glm::vec3 { normal(rng), normal(rng), normal(rng) });
+
+        r.origin = bounds.centre() + side * radius;
+        r.dir = glm::normalize(target - r.origin);
+    }
+
+    return rays;
+}
+
+// Best of a few passes, so that a context switch doesn't skew the result
+template <typename F>
+static double best_seconds(F run) {
+    double best { 0.0 };
+
+    for (int pass = 0 ; pass < BENCH_PASSES ; pass += 1) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        if (pass == 0 || elapsed.count() < best) best = elapsed.count();
+    }
+
+    return best;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) error("Usage: raycast_bench <model>...");
+
+    std::cout << "Worker threads: " << worker_pool().concurrency() << std::endl;
+
+    for (int a = 1 ; a < argc ; a += 1) {
+        std::string file_name { argv[a] };
+
+        std::vector<glm::vec3> positions {};
+        std::vector<unsigned int> indices {};
+        load_triangles(file_name, positions, indices);
+
+        triangle_bvh tree {};
+
+        auto build_start = std::chrono::steady_clock::now();
+        tree.build(positions, indices);
+        std::chrono::duration<double, std::milli> build_ms = std::chrono::steady_clock::now() - build_start;
+
+        std::vector<ray> rays = make_rays(tree.bounds(), BENCH_RAYS);
+        std::vector<float> distances(rays.size());
+
+        auto trace = [&](std::size_t i) {
+            float t_max = std::numeric_limits<float>::max();
+            unsigned int triangle { 0 };
+
+            distances[i] = tree.intersect(rays[i], t_max, triangle) ? t_max : -1.0f;
+        };
+
+        double single = best_seconds([&]() {
+            for (std::size_t i = 0 ; i < rays.size() ; i += 1) trace(i);
+        });
+
+        std::size_t hits { 0 };
+        for (float d : distances) hits += d >= 0.0f;
+
+        double many = best_seconds([&]() {
+            worker_pool().parallel_for(rays.size(), 256, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin ; i < end ; i += 1) trace(i);
+            });
+        });
+
+        std::size_t many_hits { 0 };
+        for (float d : distances) many_hits += d >= 0.0f;
+
+        if (hits != many_hits) error("\"" + file_name + "\": raycast and raycast_many disagree on the hits.");
+
+        std::cout << file_name << ": " << indices.size() / 3 << " triangles, BVH built in " << build_ms.count() << " ms, "
+                  << 100.0 * hits / rays.size() << "% of rays hit" << std::endl;
+        std::cout << "    raycast:      " << rays.size() / single / 1e6 << " Mrays/s" << std::endl;
+        std::cout << "    raycast_many: " << rays.size() / many / 1e6 << " Mrays/s" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+#include <glad/glad.h>
+
+#include "reflection_probe.h"
+#include "residency.h"
+#include "utilities.h"
+
+// Cache files start with this, then the resolution, then the faces
+static const char probe_cache_magic[4] { 'P', 'R', 'B', '1' };
+
+void reflection_probe::allocate() {
+    if (cubemap) return;
+
+    glGenTextures(1, &cubemap);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+
+    for (int i = 0 ; i < 6 ; i += 1) {
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA8, resolution, resolution, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    residency().track_fixed(GL_TEXTURE, cubemap, static_cast<std::size_t>(resolution) * resolution * 4 * 6);
+}
+
+void reflection_probe::destroy() {
+    if (cubemap) {
+        residency().untrack_fixed(GL_TEXTURE, cubemap);
+        glDeleteTextures(1, &cubemap);
+    }
+
+    cubemap = 0;
+    captured = false;
+}
+
+void reflection_probe::bind(GLenum texture_unit) const {
+    glActiveTexture(texture_unit);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+}
+
+bool reflection_probe::read_cache(std::vector<unsigned char>& faces) const {
+    if (cache.empty()) return false;
+
+    std::ifstream file { cache, std::ios::binary };
+    if (!file.is_open()) return false;
+
+    char magic[4] {};
+    int cached_resolution { 0 };
+
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&cached_resolution), sizeof(cached_resolution));
+
+    // Captures at another resolution are out of date
+    if (!file || std::memcmp(magic, probe_cache_magic, sizeof(magic)) != 0 || cached_resolution != resolution) return false;
+
+    faces.resize(6 * resolution * resolution * 4);
+    file.read(reinterpret_cast<char*>(&faces[0]), faces.size());
+
+    return static_cast<bool>(file);
+}
+
+void reflection_probe::write_cache(const std::vector<unsigned char>& faces) const {
+    if (cache.empty()) return;
+
+    std::ofstream file { cache, std::ios::binary };
+
+    if (!file.is_open()) {
+        std::cerr << "Warning: unable to write the reflection probe cache \"" << cache << "\"." << std::endl;
+        return;
+    }
+
+    file.write(probe_cache_magic, sizeof(probe_cache_magic));
+    file.write(reinterpret_cast<const char*>(&resolution), sizeof(resolution));
+    file.write(reinterpret_cast<const char*>(&faces[0]), faces.size());
+}
+
+bool reflection_probe::load_cache() {
+    std::vector<unsigned char> faces {};
+    if (!read_cache(faces)) return false;
+
+    allocate();
+
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    std::size_t face_size = resolution * resolution * 4;
+
+    for (int i = 0 ; i < 6 ; i += 1) {
+        glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 0, 0, resolution, resolution, GL_RGBA, GL_UNSIGNED_BYTE,
+                        &faces[i * face_size]);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    gl_error_check_barrier
+
+    set_captured();
+    return true;
+}
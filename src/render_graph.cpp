@@ -0,0 +1,224 @@
+#include <iostream>
+#include <algorithm>
+
+#include "render_graph.h"
+#include "utilities.h"
+
+void render_graph::clear() {
+    m_passes.clear();
+    m_resources.clear();
+}
+
+render_graph::resource render_graph::create_target(const std::string& name, const render_target_desc& desc) {
+    graph_resource r {};
+    r.name = name;
+    r.desc = desc;
+
+    m_resources.push_back(r);
+    return m_resources.size() - 1;
+}
+
+render_graph::resource render_graph::import_resource(const std::string& name) {
+    graph_resource r {};
+    r.name = name;
+    r.imported = true;
+
+    m_resources.push_back(r);
+    return m_resources.size() - 1;
+}
+
+void render_graph::register_passes(int stage, pass_declarer declare) {
+    m_declarers.push_back({ stage, std::move(declare) });
+}
+
+void render_graph::declare_stage(int stage) {
+    for (auto& [declarer_stage, declare] : m_declarers) {
+        if (declarer_stage == stage) declare(*this);
+    }
+}
+
+render_graph::resource render_graph::find(const std::string& name) const {
+    for (int i = 0 ; i < m_resources.size() ; i += 1) {
+        if (m_resources[i].name == name) return i;
+    }
+
+    return -1;
+}
+
+void render_graph::add_pass(const std::string& name, const std::vector<resource>& reads, const std::vector<resource>& writes,
+                            std::function<void()> execute, bool side_effects) {
+    for (const std::vector<resource>* list : { &reads, &writes }) {
+        for (resource r : *list) {
+            if (r >= 0 && r < m_resources.size()) continue;
+
+            std::cerr << "Pass '" << name << "' uses a render target that wasn't declared this frame." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    m_passes.push_back({ name, reads, writes, std::move(execute), side_effects, false });
+}
+
+void render_graph::execute(int screen_width, int screen_height, gpu_profiler* profiler) {
+    cull();
+    allocate(screen_width, screen_height);
+
+    for (pass& p : m_passes) {
+        if (p.culled) continue;
+
+        if (profiler) profiler->begin_pass(p.name);
+        p.execute();
+        if (profiler) profiler->end_pass();
+    }
+
+    gl_error_check_barrier
+}
+
+fbo& render_graph::target(resource r) {
+    graph_resource& res = m_resources[r];
+
+    if (res.imported || res.pooled < 0) {
+        std::cerr << "Render target '" << res.name << "' was used outside the passes that declared it." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    return m_pool[res.pooled].target;
+}
+
+void render_graph::destroy() {
+    for (pooled_target& p : m_pool) p.target.destroy();
+
+    m_pool.clear();
+    clear();
+}
+
+void render_graph::cull() {
+
+    // Working back from the passes with side effects, a pass is kept if anything kept after it reads what it writes
+    std::vector<bool> needed(m_resources.size(), false);
+
+    for (int i = static_cast<int>(m_passes.size()) - 1 ; i >= 0 ; i -= 1) {
+        pass& p = m_passes[i];
+
+        bool keep = p.side_effects;
+        for (resource r : p.writes) keep = keep || needed[r];
+
+        p.culled = !keep;
+        if (p.culled) continue;
+
+        for (resource r : p.reads) needed[r] = true;
+    }
+
+    // Every transient target a kept pass reads must have been written by a kept pass before it
+    std::vector<bool> written(m_resources.size(), false);
+
+    for (pass& p : m_passes) {
+        if (p.culled) continue;
+
+        for (resource r : p.reads) {
+            if (m_resources[r].imported || written[r]) continue;
+
+            std::cerr << "Pass '" << p.name << "' reads render target '" << m_resources[r].name
+                      << "' before any pass writes it." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        for (resource r : p.writes) written[r] = true;
+    }
+}
+
+void render_graph::allocate(int screen_width, int screen_height) {
+
+    // Lifetimes, from the first pass to touch each target to the last
+    for (int i = 0 ; i < m_passes.size() ; i += 1) {
+        pass& p = m_passes[i];
+        if (p.culled) continue;
+
+        for (const std::vector<resource>* list : { &p.reads, &p.writes }) {
+            for (resource r : *list) {
+                graph_resource& res = m_resources[r];
+                if (res.first_pass < 0) res.first_pass = i;
+                res.last_pass = std::max(res.last_pass, i);
+            }
+        }
+    }
+
+    std::vector<resource> order {};
+
+    for (int i = 0 ; i < m_resources.size() ; i += 1) {
+        if (!m_resources[i].imported && m_resources[i].first_pass >= 0) order.push_back(i);
+    }
+
+    std::sort(order.begin(), order.end(), [this](resource a, resource b) {
+        return m_resources[a].first_pass < m_resources[b].first_pass;
+    });
+
+    for (pooled_target& p : m_pool) p.busy_until = -1;
+
+    // A target can take over a framebuffer of the same kind as soon as the last target in it is done with it
+    for (resource r : order) {
+        graph_resource& res = m_resources[r];
+
+        int width = res.desc.width;
+        int height = res.desc.height;
+
+        if (res.desc.divisor > 0) {
+            width = std::max(screen_width / res.desc.divisor, 1);
+            height = std::max(screen_height / res.desc.divisor, 1);
+        }
+
+        auto free = std::find_if(m_pool.begin(), m_pool.end(), [&res, width, height](const pooled_target& p) {
+            return p.desc == res.desc && p.width == width && p.height == height && p.busy_until < res.first_pass;
+        });
+
+        if (free == m_pool.end()) {
+            pooled_target p {};
+            p.desc = res.desc;
+            p.width = width;
+            p.height = height;
+
+            if (res.desc.levels > 1) p.target.initialise_pyramid(width, height, res.desc.levels);
+            else p.target.initialise_targets(width, height, res.desc.formats, res.desc.depth_format);
+
+            m_pool.push_back(std::move(p));
+            free = m_pool.end() - 1;
+        }
+
+        free->busy_until = res.last_pass;
+        res.pooled = free - m_pool.begin();
+    }
+
+    // Framebuffers no target wanted for a while are freed, as are screen sized ones left over from the window's old size
+    for (pooled_target& p : m_pool) {
+        if (p.busy_until >= 0) {
+            p.idle_frames = 0;
+            continue;
+        }
+
+        p.idle_frames += 1;
+
+        bool resized = p.desc.divisor > 0 && (p.width != std::max(screen_width / p.desc.divisor, 1) ||
+                                              p.height != std::max(screen_height / p.desc.divisor, 1));
+
+        if (resized || p.idle_frames > RENDER_GRAPH_IDLE_FRAMES) {
+            p.target.destroy();
+            p.idle_frames = -1;
+        }
+    }
+
+    std::vector<pooled_target> kept {};
+    std::vector<int> moved(m_pool.size(), -1);
+
+    for (int i = 0 ; i < m_pool.size() ; i += 1) {
+        if (m_pool[i].idle_frames < 0) continue;
+
+        moved[i] = kept.size();
+        kept.push_back(std::move(m_pool[i]));
+    }
+
+    for (graph_resource& res : m_resources) {
+        if (res.pooled >= 0) res.pooled = moved[res.pooled];
+    }
+
+    m_pool = std::move(kept);
+}
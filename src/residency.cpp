@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cmath>
+
+#include <glad/glad.h>
+
+#include "residency.h"
+#include "texture.h"
+#include "texture_streamer.h"
+#include "utilities.h"
+
+static std::uint64_t fixed_key(GLenum type, GLuint name) {
+    return (static_cast<std::uint64_t>(type) << 32) | name;
+}
+
+std::size_t residency_manager::used() const {
+    std::size_t total { 0 };
+
+    for (const auto& [key, bytes] : m_fixed) total += bytes;
+    for (const auto& [t, tracked] : m_textures) total += bytes_from(tracked, tracked.base_level);
+
+    return total;
+}
+
+void residency_manager::track_fixed(GLenum type, GLuint name, std::size_t bytes) {
+    m_fixed[fixed_key(type, name)] = bytes;
+}
+
+void residency_manager::untrack_fixed(GLenum type, GLuint name) {
+    m_fixed.erase(fixed_key(type, name));
+}
+
+void residency_manager::track_texture(texture* t, int width, const std::vector<std::size_t>& level_bytes) {
+
+    // Levels streamed back in come through here again; what's resident is already known
+    if (m_textures.count(t) > 0) return;
+
+    tracked_texture& tracked = m_textures[t];
+    tracked.width = width;
+    tracked.level_bytes = level_bytes;
+    tracked.base_level = 0;
+    tracked.needed_level = lowest_base(tracked);
+}
+
+void residency_manager::untrack_texture(texture* t) {
+    m_textures.erase(t);
+}
+
+void residency_manager::need(texture* t, float pixels, unsigned int frame) {
+    auto it = m_textures.find(t);
+    if (it == m_textures.end()) return;
+
+    tracked_texture& tracked = it->second;
+
+    // Each level halves the texels across, so the level that's enough is the log of how many too many there are
+    float texels_per_pixel = tracked.width / (std::max(pixels, 1.0f) * RESIDENCY_TEXEL_BIAS);
+    int level = std::clamp(static_cast<int>(std::ceil(std::log2(std::max(texels_per_pixel, 1.0f)))), 0,
+                           static_cast<int>(tracked.level_bytes.size()) - 1);
+
+    if (tracked.last_needed != frame) {
+        tracked.last_needed = frame;
+        tracked.needed_level = level;
+    } else {
+        tracked.needed_level = std::min(tracked.needed_level, level);
+    }
+}
+
+void residency_manager::update(unsigned int frame) {
+    std::size_t total = used();
+
+    if (total > m_budget) {
+
+        // Least recently needed first; textures still streaming are left until they're done
+        std::vector<std::pair<texture*, tracked_texture*>> order {};
+
+        for (auto& [t, tracked] : m_textures) {
+            if (!t->streaming()) order.push_back({ t, &tracked });
+        }
+
+        std::sort(order.begin(), order.end(), [](const auto& a, const auto& b) {
+            return a.second->last_needed < b.second->last_needed;
+        });
+
+        // First only the levels nobody is looking at; then, if that wasn't enough, whatever it takes
+        for (int pass = 0 ; pass < 2 && total > m_budget ; pass += 1) {
+            for (auto& [t, tracked] : order) {
+                if (total <= m_budget) break;
+
+                int lowest = lowest_base(*tracked);
+                if (pass == 0 && tracked->last_needed == frame) lowest = std::min(lowest, tracked->needed_level);
+
+                int new_base = tracked->base_level;
+
+                while (new_base < lowest && total > m_budget) {
+                    total -= tracked->level_bytes[new_base];
+                    new_base += 1;
+                }
+
+                if (new_base != tracked->base_level) drop(t, *tracked, new_base);
+            }
+        }
+
+        return;
+    }
+
+    // Bring back whatever is on screen and blurrier than it should be, for as long as it fits
+    for (auto& [t, tracked] : m_textures) {
+        if (t->streaming() || tracked.last_needed != frame || tracked.needed_level >= tracked.base_level) continue;
+
+        int new_base = tracked.base_level;
+
+        while (new_base > tracked.needed_level && total + tracked.level_bytes[new_base - 1] <= m_budget) {
+            new_base -= 1;
+            total += tracked.level_bytes[new_base];
+        }
+
+        if (new_base != tracked.base_level) restore(t, tracked, new_base);
+    }
+}
+
+std::size_t residency_manager::bytes_from(const tracked_texture& tracked, int level) {
+    std::size_t bytes { 0 };
+    for (int i = level ; i < tracked.level_bytes.size() ; i += 1) bytes += tracked.level_bytes[i];
+    return bytes;
+}
+
+int residency_manager::lowest_base(const tracked_texture& tracked) {
+    int level { 0 };
+
+    while (level < static_cast<int>(tracked.level_bytes.size()) - 1 && (tracked.width >> level) > RESIDENCY_MIN_LEVEL_WIDTH) {
+        level += 1;
+    }
+
+    return level;
+}
+
+void residency_manager::drop(texture* t, tracked_texture& tracked, int new_base) {
+    glBindTexture(t->m_texture_target, t->m_texture_object);
+    glTexParameteri(t->m_texture_target, GL_TEXTURE_BASE_LEVEL, new_base);
+
+    // Respecified as empty, so that the driver can release them; levels under the base don't affect completeness
+    for (int level = tracked.base_level ; level < new_base ; level += 1) {
+        if (t->m_texture_target == GL_TEXTURE_2D_ARRAY) {
+            glTexImage3D(t->m_texture_target, level, GL_RGBA8, 0, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        } else {
+            glTexImage2D(t->m_texture_target, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+    }
+
+    glBindTexture(t->m_texture_target, 0);
+
+    gl_error_check_barrier
+
+    tracked.base_level = new_base;
+}
+
+void residency_manager::restore(texture* t, tracked_texture& tracked, int new_base) {
+
+    // The file is decoded again, but only the missing levels are uploaded; until they are, the coarser ones show
+    t->m_streaming = true;
+    texture_stream().request(t, t->m_file_name, new_base, tracked.base_level - 1);
+
+    tracked.base_level = new_base;
+}
+
+residency_manager& residency() {
+    static residency_manager manager {};
+    return manager;
+}
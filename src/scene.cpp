@@ -1,9 +1,96 @@
+#include <vector>
+#include <optional>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/geometric.hpp>
+
 #include "serialise.h"
 #include "scene.h"
 #include "scene_node.h"
+#include "renderer.h"
+#include "workers.h"
+#include "bvh.h"
 
 namespace serial {
     void serialise_scene(std::ostream& os, const scene* sc) {
         serialise_node(os, sc->root, 0);
     }
 };
+
+void scene::build_bvh() {
+    m_bvh_nodes.clear();
+    m_bvh_models.clear();
+    m_bvh_inverse_models.clear();
+    root->get_renderers(m_bvh_nodes);
+
+    std::vector<aabb> bounds {};
+    bounds.reserve(m_bvh_nodes.size());
+
+    for (scene_node* n : m_bvh_nodes) {
+        renderer* r = static_cast<renderer*>(n->component);
+        bounds.push_back(r->world_bounds());
+        m_bvh_models.push_back(r->m_transform.get_model_matrix());
+        m_bvh_inverse_models.push_back(glm::inverse(m_bvh_models.back()));
+    }
+
+    m_bvh.build(bounds, 1);
+    m_bvh_dirty = false;
+}
+
+bool scene::bvh_moved() const {
+    for (int i = 0 ; i < m_bvh_nodes.size() ; i += 1) {
+        renderer* r = static_cast<renderer*>(m_bvh_nodes[i]->component);
+        if (r->m_transform.get_model_matrix() != m_bvh_models[i]) return true;
+    }
+
+    return false;
+}
+
+std::optional<raycast_hit> scene::trace(ray r, float max_t, unsigned int mask) const {
+    std::optional<raycast_hit> hit {};
+    bvh_ray br { r };
+
+    m_bvh.traverse(br, max_t, [&](const bvh_node& leaf, float& t_max) {
+        for (unsigned int i = leaf.left_first ; i < leaf.left_first + leaf.count ; i += 1) {
+            unsigned int index = m_bvh.m_indices[i];
+            scene_node* n = m_bvh_nodes[index];
+            renderer* rd = static_cast<renderer*>(n->component);
+
+            if ((mask & RAYCAST_MASK(rd->m_pipeline)) == 0) continue;
+
+            // Transforms are affine, so the ray parameter is the same in model space
+            const glm::mat4& inv = m_bvh_inverse_models[index];
+            ray local { glm::vec3(inv * glm::vec4(r.origin, 1.0f)), glm::vec3(inv * glm::vec4(r.dir, 0.0f)) };
+
+            unsigned int submesh { 0 };
+            unsigned int triangle { 0 };
+
+            if (rd->m_mesh.raycast(local, t_max, submesh, triangle)) {
+                hit = raycast_hit { n, submesh, triangle, r.origin + r.dir * t_max, t_max };
+            }
+        }
+    });
+
+    return hit;
+}
+
+std::optional<raycast_hit> scene::raycast(glm::vec3 origin, glm::vec3 dir, float max_t, unsigned int mask) {
+    if (m_bvh_dirty || (m_running && bvh_moved())) build_bvh();
+
+    return trace({ origin, glm::normalize(dir) }, max_t, mask);
+}
+
+void scene::raycast_many(const std::vector<ray>& rays, float max_t, unsigned int mask,
+                         std::vector<std::optional<raycast_hit>>& hits) {
+    if (m_bvh_dirty || (m_running && bvh_moved())) build_bvh();
+
+    hits.assign(rays.size(), std::nullopt);
+
+    worker_pool().parallel_for(rays.size(), 256, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin ; i < end ; i += 1) {
+            hits[i] = trace({ rays[i].origin, glm::normalize(rays[i].dir) }, max_t, mask);
+        }
+    });
+}
@@ -8,6 +8,7 @@
 #include "directional_light.h"
 #include "point_light.h"
 #include "renderer.h"
+#include "reflection_probe.h"
 #include "pipeline.h"
 
 struct application;
@@ -47,6 +48,11 @@ void scene_node::get_point_lights(std::vector<point_light*>& lights) {
     for (scene_node* child : children) child->get_point_lights(lights);
 }
 
+void scene_node::get_renderers(std::vector<scene_node*>& nodes) {
+    if (component_type == scene_node_type::renderer) nodes.push_back(this);
+    for (scene_node* child : children) child->get_renderers(nodes);
+}
+
 std::optional<camera*> scene_node::get_camera() {
     if (component_type == scene_node_type::camera) return static_cast<camera*>(component);
 
@@ -58,16 +64,16 @@ std::optional<camera*> scene_node::get_camera() {
     return std::nullopt;
 }
 
-std::optional<renderer*> scene_node::get_water_renderer() {
+void scene_node::get_water_renderers(std::vector<scene_node*>& nodes) {
     if (component_type == scene_node_type::renderer
-        && static_cast<renderer*>(component)->m_pipeline == WATER_PIPELINE) return static_cast<renderer*>(component);
+        && static_cast<renderer*>(component)->m_pipeline == WATER_PIPELINE) nodes.push_back(this);
 
-    for (scene_node* child : children) {
-        std::optional<renderer*> c = child->get_water_renderer();
-        if (c.has_value()) return c.value();
-    }
+    for (scene_node* child : children) child->get_water_renderers(nodes);
+}
 
-    return std::nullopt;
+void scene_node::get_reflection_probes(std::vector<reflection_probe*>& probes) {
+    if (component_type == scene_node_type::reflection_probe) probes.push_back(static_cast<reflection_probe*>(component));
+    for (scene_node* child : children) child->get_reflection_probes(probes);
 }
 
 /// @brief Serialisation function that is called when the scene_node appears as a reference in a field
@@ -1,58 +1,55 @@
 #include <iostream>
 
 #include <glad/glad.h>
-#include "stb_image.h"
 
 #include "texture.h"
+#include "texture_streamer.h"
+#include "residency.h"
+#include "texture_array.h"
 #include "utilities.h"
 
-void texture::load() {
-    stbi_set_flip_vertically_on_load(true);
-
-    int width, height, num_channels;
-    unsigned char* image_data = stbi_load(m_file_name.c_str(), &width, &height, &num_channels, 0);
+texture::~texture() {
+    if (m_streaming) texture_stream().cancel(this);
+    residency().untrack_texture(this);
 
-    if (!image_data) {
-        std::cerr << "Unable to load image file \"" << m_file_name << "\"." << std::endl;
-        std::cerr << "Error message: " << stbi_failure_reason() << std::endl;
-        exit(EXIT_FAILURE);
+    if (m_shared) {
+        texture_arrays().release(m_texture_object, m_layer);
+    } else {
+        texture_arrays().forget(this);
+        glDeleteTextures(1, &m_texture_object);
     }
+}
 
-    glGenTextures(1, &m_texture_object);
-    glBindTexture(m_texture_target, m_texture_object);
-
-    if (m_texture_target != GL_TEXTURE_2D) {
-        std::cerr << "Texture type unsupported; only 2D textures are possible." << std::endl;
+void texture::load() {
+    if (m_texture_target != GL_TEXTURE_2D && m_texture_target != GL_TEXTURE_2D_ARRAY) {
+        std::cerr << "Texture type unsupported; only 2D textures and 2D arrays are possible." << std::endl;
         exit(EXIT_FAILURE);
     }
-    
-    if (num_channels == 1) {
-        glTexImage2D(m_texture_target, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, image_data);
-    }
 
-    else if (num_channels == 3) {
-        glTexImage2D(m_texture_target, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image_data);
-    }
+    // Opaque white leaves whatever it's multiplied with unchanged until the image arrives
+    static const unsigned char placeholder[4] { 255, 255, 255, 255 };
 
-    else if (num_channels == 4) {
-        glTexImage2D(m_texture_target, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image_data);
-    }
+    glGenTextures(1, &m_texture_object);
+    glBindTexture(m_texture_target, m_texture_object);
 
-    else {
-        std::cerr << "Texture type unsupported; unexpected number of color channels." << std::endl;
-        exit(EXIT_FAILURE);
+    if (m_texture_target == GL_TEXTURE_2D_ARRAY) {
+        glTexImage3D(m_texture_target, 0, GL_RGBA8, 1, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+    } else {
+        glTexImage2D(m_texture_target, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
     }
 
-    gl_error_check_barrier
-
-    glTexParameterf(m_texture_target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(m_texture_target, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameterf(m_texture_target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameterf(m_texture_target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameterf(m_texture_target, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameterf(m_texture_target, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
     glBindTexture(m_texture_target, 0);
 
-    free(image_data);
+    gl_error_check_barrier
+
+    m_streaming = true;
+    texture_stream().request(this, m_file_name);
 }
 
 void texture::bind(GLenum texture_unit) const {
@@ -0,0 +1,114 @@
+#include <algorithm>
+
+#include <glad/glad.h>
+
+#include "texture_array.h"
+#include "texture_streamer.h"
+#include "residency.h"
+#include "utilities.h"
+
+bool texture_array_pool::place(texture* t, int width, int height, GLenum internal_format, GLenum format, bool compressed,
+                               const std::vector<std::size_t>& level_bytes, GLuint& texture_object, int& layer) {
+
+    if (width > TEXTURE_ARRAY_MAX_WIDTH) return false;
+
+    int levels = level_bytes.size();
+
+    for (texture_array& a : m_arrays) {
+        if (a.width != width || a.height != height || a.internal_format != internal_format || a.levels != levels) continue;
+
+        auto free = std::find(a.used.begin(), a.used.end(), false);
+        if (free == a.used.end()) continue;
+
+        *free = true;
+        texture_object = a.texture_object;
+        layer = free - a.used.begin();
+        return true;
+    }
+
+    // The first texture of its shape keeps its own array until there's another to share with
+    auto partner = std::find_if(m_waiting.begin(), m_waiting.end(), [&](const waiting_texture& w) {
+        return w.t != t && w.width == width && w.height == height && w.internal_format == internal_format && w.levels == levels;
+    });
+
+    if (partner == m_waiting.end()) {
+        if (std::none_of(m_waiting.begin(), m_waiting.end(), [t](const waiting_texture& w) { return w.t == t; })) {
+            m_waiting.push_back({ t, width, height, internal_format, levels });
+        }
+
+        return false;
+    }
+
+    texture_array a { 0, width, height, internal_format, levels, 0, std::vector<bool>(TEXTURE_ARRAY_LAYERS, false) };
+
+    glGenTextures(1, &a.texture_object);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, a.texture_object);
+
+    for (int level = 0 ; level < levels ; level += 1) {
+        int level_width = std::max(1, width >> level);
+        int level_height = std::max(1, height >> level);
+
+        if (compressed) {
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, internal_format, level_width, level_height, TEXTURE_ARRAY_LAYERS, 0,
+                                   level_bytes[level] * TEXTURE_ARRAY_LAYERS, nullptr);
+        } else {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, internal_format, level_width, level_height, TEXTURE_ARRAY_LAYERS, 0,
+                         format, GL_UNSIGNED_BYTE, nullptr);
+        }
+
+        a.layer_bytes += level_bytes[level];
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    gl_error_check_barrier
+
+    a.used[0] = true;
+    a.used[1] = true;
+    texture_object = a.texture_object;
+    layer = 0;
+
+    // Every layer's storage is allocated up front, and layers can't give their mips back, so the whole array is fixed
+    residency().track_fixed(GL_TEXTURE, a.texture_object, a.layer_bytes * TEXTURE_ARRAY_LAYERS);
+
+    // The waiting texture's decode is long gone, so it's streamed again into the other layer
+    texture* moved = partner->t;
+    m_waiting.erase(partner);
+    m_arrays.push_back(std::move(a));
+
+    texture_stream().move_to_layer(moved, texture_object, 1);
+    return true;
+}
+
+void texture_array_pool::release(GLuint texture_object, int layer) {
+    for (int i = 0 ; i < m_arrays.size() ; i += 1) {
+        texture_array& a = m_arrays[i];
+        if (a.texture_object != texture_object) continue;
+
+        a.used[layer] = false;
+
+        if (std::find(a.used.begin(), a.used.end(), true) != a.used.end()) return;
+
+        residency().untrack_fixed(GL_TEXTURE, a.texture_object);
+        glDeleteTextures(1, &a.texture_object);
+
+        m_arrays.erase(m_arrays.begin() + i);
+        return;
+    }
+}
+
+void texture_array_pool::forget(texture* t) {
+    m_waiting.erase(std::remove_if(m_waiting.begin(), m_waiting.end(), [t](const waiting_texture& w) { return w.t == t; }),
+                    m_waiting.end());
+}
+
+texture_array_pool& texture_arrays() {
+    static texture_array_pool pool {};
+    return pool;
+}
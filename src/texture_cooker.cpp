@@ -0,0 +1,360 @@
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "stb_image.h"
+#include "ktx.h"
+
+// Offline texture cook step. Every image given is turned into a full mip chain, block compressed, and written
+// next to it as a .ktx for texture::load to upload directly:
+//  - one channel images become BC4
+//  - three channel images, and four channel ones that are fully opaque, become BC1
+//  - the rest become BC3
+// Colour textures are stored sRGB encoded, so their mips are filtered in linear space; images following
+// --linear (until --srgb) hold data rather than colour, and are filtered as they are.
+
+#define GL_RED  0x1903
+#define GL_RGB  0x1907
+#define GL_RGBA 0x1908
+
+struct image {
+    int width { 0 };
+    int height { 0 };
+    int channels { 0 };
+
+    // Linear values in [0, 1], channels interleaved
+    std::vector<float> pixels {};
+
+    float& at(int x, int y, int c) {
+        return pixels[(std::min(y, height - 1) * width + std::min(x, width - 1)) * channels + c];
+    }
+};
+
+void error(std::string message) {
+    std::cout << message << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+static float srgb_to_linear(float v) {
+    return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linear_to_srgb(float v) {
+    return v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+}
+
+// Alpha, and single channel images, are never colour
+static bool is_colour_channel(const image& img, int c, bool srgb) {
+    return srgb && img.channels >= 3 && c < 3;
+}
+
+// Each texel of the next level is the average of the 2x2 texels it covers; odd edges repeat their last texel
+static image downsample(image& src) {
+    image dst {};
+    dst.width = std::max(1, src.width / 2);
+    dst.height = std::max(1, src.height / 2);
+    dst.channels = src.channels;
+    dst.pixels.resize(dst.width * dst.height * dst.channels);
+
+    for (int y = 0 ; y < dst.height ; y += 1) {
+        for (int x = 0 ; x < dst.width ; x += 1) {
+            for (int c = 0 ; c < dst.channels ; c += 1) {
+                float sum = src.at(x * 2, y * 2, c) + src.at(x * 2 + 1, y * 2, c)
+                          + src.at(x * 2, y * 2 + 1, c) + src.at(x * 2 + 1, y * 2 + 1, c);
+
+                dst.at(x, y, c) = sum * 0.25f;
+            }
+        }
+    }
+
+    return dst;
+}
+
+static unsigned char to_byte(float v) {
+    return static_cast<unsigned char>(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+static unsigned short pack_565(const float c[3]) {
+    int r = static_cast<int>(std::clamp(c[0], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+    int g = static_cast<int>(std::clamp(c[1], 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+    int b = static_cast<int>(std::clamp(c[2], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+
+    return static_cast<unsigned short>((r << 11) | (g << 5) | b);
+}
+
+static void unpack_565(unsigned short v, float c[3]) {
+    c[0] = ((v >> 11) & 31) * 255.0f / 31.0f;
+    c[1] = ((v >> 5) & 63) * 255.0f / 63.0f;
+    c[2] = (v & 31) * 255.0f / 31.0f;
+}
+
+// Endpoints are the extremes of the block along its principal axis, pulled in slightly, since the
+// interpolated colours cover the middle of the range better than the ends
+static void encode_bc1(const unsigned char block[16][4], unsigned char out[8]) {
+    float mean[3] { 0, 0, 0 };
+
+    for (int i = 0 ; i < 16 ; i += 1) {
+        for (int c = 0 ; c < 3 ; c += 1) mean[c] += block[i][c] / 16.0f;
+    }
+
+    float cov[3][3] {};
+
+    for (int i = 0 ; i < 16 ; i += 1) {
+        float d[3] { block[i][0] - mean[0], block[i][1] - mean[1], block[i][2] - mean[2] };
+
+        for (int a = 0 ; a < 3 ; a += 1) {
+            for (int b = 0 ; b < 3 ; b += 1) cov[a][b] += d[a] * d[b];
+        }
+    }
+
+    // Power iteration for the principal axis
+    float axis[3] { 1, 1, 1 };
+
+    for (int iteration = 0 ; iteration < 8 ; iteration += 1) {
+        float next[3] {};
+
+        for (int a = 0 ; a < 3 ; a += 1) next[a] = cov[a][0] * axis[0] + cov[a][1] * axis[1] + cov[a][2] * axis[2];
+
+        float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length < 1e-6f) break;
+
+        for (int a = 0 ; a < 3 ; a += 1) axis[a] = next[a] / length;
+    }
+
+    float min_t { 1e9f };
+    float max_t { -1e9f };
+
+    for (int i = 0 ; i < 16 ; i += 1) {
+        float t = (block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] + (block[i][2] - mean[2]) * axis[2];
+        min_t = std::min(min_t, t);
+        max_t = std::max(max_t, t);
+    }
+
+    float inset = (max_t - min_t) / 16.0f;
+    float hi[3] {};
+    float lo[3] {};
+
+    for (int c = 0 ; c < 3 ; c += 1) {
+        hi[c] = mean[c] + axis[c] * (max_t - inset);
+        lo[c] = mean[c] + axis[c] * (min_t + inset);
+    }
+
+    unsigned short c0 = pack_565(hi);
+    unsigned short c1 = pack_565(lo);
+
+    // c0 > c1 selects the four colour mode
+    if (c0 < c1) std::swap(c0, c1);
+
+    unsigned int indices { 0 };
+
+    if (c0 != c1) {
+        float palette[4][3] {};
+        unpack_565(c0, palette[0]);
+        unpack_565(c1, palette[1]);
+
+        for (int c = 0 ; c < 3 ; c += 1) {
+            palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+            palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+        }
+
+        for (int i = 0 ; i < 16 ; i += 1) {
+            int best { 0 };
+            float best_distance { 1e9f };
+
+            for (int p = 0 ; p < 4 ; p += 1) {
+                float dr = block[i][0] - palette[p][0];
+                float dg = block[i][1] - palette[p][1];
+                float db = block[i][2] - palette[p][2];
+                float distance = dr * dr + dg * dg + db * db;
+
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best = p;
+                }
+            }
+
+            indices |= best << (i * 2);
+        }
+    }
+
+    out[0] = c0 & 0xFF;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF;
+    out[3] = c1 >> 8;
+
+    for (int i = 0 ; i < 4 ; i += 1) out[4 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+// One channel, with endpoints at the block's extremes and six values between them
+static void encode_bc4(const unsigned char values[16], unsigned char out[8]) {
+    unsigned char hi = *std::max_element(values, values + 16);
+    unsigned char lo = *std::min_element(values, values + 16);
+
+    out[0] = hi;
+    out[1] = lo;
+
+    std::uint64_t indices { 0 };
+
+    if (hi != lo) {
+        float palette[8] { static_cast<float>(hi), static_cast<float>(lo) };
+        for (int i = 1 ; i < 7 ; i += 1) palette[i + 1] = ((7 - i) * hi + i * lo) / 7.0f;
+
+        for (int i = 0 ; i < 16 ; i += 1) {
+            int best { 0 };
+            float best_distance { 1e9f };
+
+            for (int p = 0 ; p < 8 ; p += 1) {
+                float distance = std::abs(values[i] - palette[p]);
+
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best = p;
+                }
+            }
+
+            indices |= static_cast<std::uint64_t>(best) << (i * 3);
+        }
+    }
+
+    for (int i = 0 ; i < 6 ; i += 1) out[2 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+static std::vector<unsigned char> compress(image& level, std::uint32_t format, bool srgb) {
+    int blocks_x = (level.width + 3) / 4;
+    int blocks_y = (level.height + 3) / 4;
+    int block_size = format == KTX_COMPRESSED_RGBA_BC3 ? 16 : 8;
+
+    std::vector<unsigned char> result(blocks_x * blocks_y * block_size);
+
+    for (int by = 0 ; by < blocks_y ; by += 1) {
+        for (int bx = 0 ; bx < blocks_x ; bx += 1) {
+            unsigned char block[16][4] {};
+
+            // Blocks past the edge repeat the last row and column
+            for (int i = 0 ; i < 16 ; i += 1) {
+                for (int c = 0 ; c < level.channels ; c += 1) {
+                    float v = level.at(bx * 4 + i % 4, by * 4 + i / 4, c);
+                    block[i][c] = to_byte(is_colour_channel(level, c, srgb) ? linear_to_srgb(v) : v);
+                }
+            }
+
+            unsigned char* out = &result[(by * blocks_x + bx) * block_size];
+
+            if (format == KTX_COMPRESSED_RED_BC4) {
+                unsigned char values[16];
+                for (int i = 0 ; i < 16 ; i += 1) values[i] = block[i][0];
+
+                encode_bc4(values, out);
+            } else if (format == KTX_COMPRESSED_RGBA_BC3) {
+                unsigned char alpha[16];
+                for (int i = 0 ; i < 16 ; i += 1) alpha[i] = block[i][3];
+
+                encode_bc4(alpha, out);
+                encode_bc1(block, out + 8);
+            } else {
+                encode_bc1(block, out);
+            }
+        }
+    }
+
+    return result;
+}
+
+static void cook(const std::string& file_name, bool srgb) {
+
+    // Matches the orientation texture::load gives uncooked images
+    stbi_set_flip_vertically_on_load(true);
+
+    int width, height, num_channels;
+    unsigned char* data = stbi_load(file_name.c_str(), &width, &height, &num_channels, 0);
+
+    if (!data) error("Failed to load image " + file_name + ", halting texture cooking...");
+
+    if (num_channels == 2) {
+        std::cout << "Skipping " << file_name << "; two channel images are left uncooked." << std::endl;
+        stbi_image_free(data);
+        return;
+    }
+
+    image level {};
+    level.width = width;
+    level.height = height;
+    level.channels = num_channels;
+    level.pixels.resize(width * height * num_channels);
+
+    bool opaque { true };
+
+    for (int i = 0 ; i < width * height * num_channels ; i += 1) {
+        float v = data[i] / 255.0f;
+        level.pixels[i] = is_colour_channel(level, i % num_channels, srgb) ? srgb_to_linear(v) : v;
+
+        if (num_channels == 4 && i % 4 == 3 && data[i] != 255) opaque = false;
+    }
+
+    stbi_image_free(data);
+
+    std::uint32_t format { KTX_COMPRESSED_RGB_BC1 };
+    std::uint32_t base_format { GL_RGB };
+
+    if (num_channels == 1) {
+        format = KTX_COMPRESSED_RED_BC4;
+        base_format = GL_RED;
+    } else if (num_channels == 4 && !opaque) {
+        format = KTX_COMPRESSED_RGBA_BC3;
+        base_format = GL_RGBA;
+    }
+
+    std::vector<std::vector<unsigned char>> levels {};
+
+    while (true) {
+        levels.push_back(compress(level, format, srgb));
+
+        if (level.width == 1 && level.height == 1) break;
+        level = downsample(level);
+    }
+
+    ktx_header header {};
+    header.endianness = KTX_ENDIANNESS;
+    header.gl_type_size = 1;
+    header.gl_internal_format = format;
+    header.gl_base_internal_format = base_format;
+    header.pixel_width = width;
+    header.pixel_height = height;
+    header.number_of_faces = 1;
+    header.number_of_mipmap_levels = levels.size();
+
+    std::string out_name { file_name + KTX_EXTENSION };
+    std::ofstream file { out_name, std::ios::binary };
+
+    if (!file.is_open()) error("Failed to open file " + out_name + ", halting texture cooking...");
+
+    file.write(reinterpret_cast<const char*>(ktx_identifier), sizeof(ktx_identifier));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // Block sizes are multiples of four, so levels never need padding
+    for (std::vector<unsigned char>& data : levels) {
+        std::uint32_t size = data.size();
+        file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        file.write(reinterpret_cast<const char*>(&data[0]), size);
+    }
+
+    std::cout << file_name << " -> " << out_name << " (" << levels.size() << " levels)" << std::endl;
+}
+
+int main(int argv, char** args) {
+    std::cout << "Cooking textures..." << std::endl;
+
+    bool srgb { true };
+
+    for (int i = 1 ; i < argv ; i += 1) {
+        std::string arg { args[i] };
+
+        if (arg == "--linear") srgb = false;
+        else if (arg == "--srgb") srgb = true;
+        else cook(arg, srgb);
+    }
+}
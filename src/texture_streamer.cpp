@@ -0,0 +1,403 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <chrono>
+
+#include <glad/glad.h>
+#include "stb_image.h"
+
+#include "texture_streamer.h"
+#include "texture.h"
+#include "residency.h"
+#include "texture_array.h"
+#include "workers.h"
+#include "utilities.h"
+#include "ktx.h"
+
+texture_streamer::~texture_streamer() {
+    for (decoded* d : m_uploading) delete d;
+
+#ifdef __EMSCRIPTEN__
+    for (decoded* d : m_pending) delete d;
+#endif
+
+    for (decoded* d = m_completed.exchange(nullptr) ; d ; ) {
+        decoded* next = d->next;
+        delete d;
+        d = next;
+    }
+}
+
+void texture_streamer::request(texture* t, const std::string& file_name, int first_level, int last_level) {
+    start(t, file_name, first_level, last_level, 0, 0);
+}
+
+void texture_streamer::move_to_layer(texture* t, GLuint array, int layer) {
+
+    // Shared layers can't drop mips, so the residency manager lets go of it
+    residency().untrack_texture(t);
+
+    // A decode still uploading already has every mip, so it's only sent to the layer instead, from the smallest again
+    for (decoded* d : m_uploading) {
+        if (m_requests[d->request] != t || d->first_level != 0 || d->last_level >= 0) continue;
+
+        d->array = array;
+        d->layer = layer;
+        d->next_level = d->mips.size() - 1;
+        return;
+    }
+
+    // Anything else on its way, like levels the residency manager asked back, is for the texture it's leaving
+    if (t->m_streaming) cancel(t);
+
+    t->m_streaming = true;
+    start(t, t->m_file_name, 0, -1, array, layer);
+}
+
+void texture_streamer::start(texture* t, const std::string& file_name, int first_level, int last_level, GLuint array, int layer) {
+
+    // Which cooked formats are usable can only be asked on the GL thread
+    if (!m_formats_known) {
+        for (GLenum format : { KTX_COMPRESSED_RGB_BC1, KTX_COMPRESSED_RGBA_BC3, KTX_COMPRESSED_RED_BC4 }) {
+            if (gl_has_compressed_format(format)) m_compressed_formats.push_back(format);
+        }
+
+        m_formats_known = true;
+    }
+
+    std::uint64_t id = m_next_request;
+    m_next_request += 1;
+    m_requests[id] = t;
+
+    decoded* d = new decoded {};
+    d->request = id;
+    d->file_name = file_name;
+    d->first_level = first_level;
+    d->last_level = last_level;
+    d->array = array;
+    d->layer = layer;
+
+#ifdef __EMSCRIPTEN__
+    // There are no workers to hand it to, and decoding here would hold up whoever asked for the texture
+    m_pending.push_back(d);
+#else
+    std::vector<GLenum> formats { m_compressed_formats };
+
+    worker_pool().submit_background([this, d, formats]() {
+        decode(*d, formats);
+        push(d);
+    });
+#endif
+}
+
+void texture_streamer::cancel(texture* t) {
+    for (auto it = m_requests.begin() ; it != m_requests.end() ; ) {
+        if (it->second != t) {
+            ++it;
+            continue;
+        }
+
+        std::uint64_t id = it->first;
+        it = m_requests.erase(it);
+
+        // Decodes still on the workers are dropped when they arrive
+        for (int i = 0 ; i < m_uploading.size() ; i += 1) {
+            if (m_uploading[i]->request != id) continue;
+
+            decoded* d = m_uploading[i];
+            if (d->array && d->next_level == static_cast<int>(d->mips.size()) - 1) texture_arrays().release(d->array, d->layer);
+
+            delete d;
+            m_uploading.erase(m_uploading.begin() + i);
+            break;
+        }
+    }
+}
+
+// Lock-free push; any number of workers can finish at once, and only the GL thread takes from the list
+void texture_streamer::push(decoded* d) {
+    d->next = m_completed.load(std::memory_order_relaxed);
+    while (!m_completed.compare_exchange_weak(d->next, d, std::memory_order_release, std::memory_order_relaxed)) {}
+}
+
+void texture_streamer::update(std::size_t budget) {
+
+#ifdef __EMSCRIPTEN__
+    auto start = std::chrono::steady_clock::now();
+    int decoded_count { 0 };
+
+    for ( ; decoded_count < m_pending.size() ; decoded_count += 1) {
+        std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if (decoded_count > 0 && elapsed.count() > TEXTURE_DECODE_BUDGET_MS) break;
+
+        // Requests cancelled while they waited are dropped below, without being decoded
+        decoded* d = m_pending[decoded_count];
+        if (m_requests.count(d->request) > 0) decode(*d, m_compressed_formats);
+
+        push(d);
+    }
+
+    m_pending.erase(m_pending.begin(), m_pending.begin() + decoded_count);
+#endif
+
+    std::vector<decoded*> arrived {};
+    for (decoded* d = m_completed.exchange(nullptr, std::memory_order_acquire) ; d ; d = d->next) arrived.push_back(d);
+
+    // The list is newest first
+    for (int i = arrived.size() - 1 ; i >= 0 ; i -= 1) {
+        decoded* d = arrived[i];
+
+        if (!d->error.empty()) {
+            std::cerr << "Unable to load image file \"" << d->file_name << "\"." << std::endl;
+            std::cerr << "Error message: " << d->error << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        if (m_requests.count(d->request) == 0) {
+            if (d->array) texture_arrays().release(d->array, d->layer);
+
+            delete d;
+            continue;
+        }
+
+        std::vector<std::size_t> level_bytes {};
+        for (const mip& m : d->mips) level_bytes.push_back(m.data.size());
+
+        // Array textures share an array with others of the same shape if they can; only those left on their own can
+        // have their mips dropped. Textures being moved into a layer already have one.
+        texture* t = m_requests[d->request];
+        bool whole = d->first_level == 0 && d->last_level < 0;
+
+        if (!d->array && !(t->m_texture_target == GL_TEXTURE_2D_ARRAY && whole
+                && texture_arrays().place(t, d->mips[0].width, d->mips[0].height, d->internal_format, d->format, d->compressed,
+                                          level_bytes, d->array, d->layer))) {
+            residency().track_texture(t, d->mips[0].width, level_bytes);
+        }
+
+        int last = d->mips.size() - 1;
+        d->next_level = d->last_level < 0 ? last : std::min(d->last_level, last);
+        m_uploading.push_back(d);
+    }
+
+    std::size_t used { 0 };
+
+    // Always the smallest waiting mip next, so that every texture sharpens at the same pace
+    while (!m_uploading.empty()) {
+        auto smallest = std::min_element(m_uploading.begin(), m_uploading.end(), [](decoded* a, decoded* b) {
+            return a->mips[a->next_level].data.size() < b->mips[b->next_level].data.size();
+        });
+
+        decoded* d = *smallest;
+        std::size_t size = d->mips[d->next_level].data.size();
+
+        if (used > 0 && used + size > budget) break;
+
+        texture* t = m_requests[d->request];
+        upload(t, *d, d->next_level);
+
+        used += size;
+        d->next_level -= 1;
+
+        if (d->next_level < d->first_level) {
+            t->m_streaming = false;
+            m_requests.erase(d->request);
+
+            delete d;
+            m_uploading.erase(smallest);
+        }
+    }
+}
+
+void texture_streamer::upload(texture* t, decoded& d, int level) {
+    const mip& m = d.mips[level];
+    const void* pixels = &m.data[0];
+
+#ifndef __EMSCRIPTEN__
+    // Staged through a pixel buffer, so the copy into the texture happens on the driver's time; the buffer is
+    // orphaned for each mip rather than waited on
+    if (m_pbo == 0) glGenBuffers(1, &m_pbo);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, m.data.size(), nullptr, GL_STREAM_DRAW);
+
+    void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m.data.size(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    std::memcpy(staging, pixels, m.data.size());
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    pixels = nullptr;
+#endif
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    if (d.array) {
+
+        // The placeholder is given up for the shared layer; the material table tells the shaders which levels are there
+        if (!t->m_shared) {
+            glDeleteTextures(1, &t->m_texture_object);
+
+            t->m_texture_object = d.array;
+            t->m_layer = d.layer;
+            t->m_shared = true;
+        }
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, d.array);
+
+        if (d.compressed) {
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, d.layer, m.width, m.height, 1, d.internal_format,
+                                      m.data.size(), pixels);
+        } else {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, d.layer, m.width, m.height, 1, d.format, GL_UNSIGNED_BYTE, pixels);
+        }
+
+        t->m_min_level = level;
+    } else {
+        glBindTexture(t->m_texture_target, t->m_texture_object);
+
+        if (t->m_texture_target == GL_TEXTURE_2D_ARRAY && d.compressed) {
+            glCompressedTexImage3D(t->m_texture_target, level, d.internal_format, m.width, m.height, 1, 0, m.data.size(), pixels);
+        } else if (t->m_texture_target == GL_TEXTURE_2D_ARRAY) {
+            glTexImage3D(t->m_texture_target, level, d.internal_format, m.width, m.height, 1, 0, d.format, GL_UNSIGNED_BYTE, pixels);
+        } else if (d.compressed) {
+            glCompressedTexImage2D(t->m_texture_target, level, d.internal_format, m.width, m.height, 0, m.data.size(), pixels);
+        } else {
+            glTexImage2D(t->m_texture_target, level, d.internal_format, m.width, m.height, 0, d.format, GL_UNSIGNED_BYTE, pixels);
+        }
+
+        // Only the levels that have arrived are sampled; the placeholder is left out once the first one has
+        glTexParameteri(t->m_texture_target, GL_TEXTURE_BASE_LEVEL, level);
+        glTexParameteri(t->m_texture_target, GL_TEXTURE_MAX_LEVEL, d.mips.size() - 1);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glBindTexture(t->m_texture_target, 0);
+
+#ifndef __EMSCRIPTEN__
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+#endif
+
+    gl_error_check_barrier
+}
+
+// Cooked files are already mipmapped and compressed; false if there isn't one in a format the driver takes
+static bool read_cooked(const std::string& file_name, const std::vector<GLenum>& compressed_formats,
+                        GLenum& internal_format, std::vector<std::vector<unsigned char>>& levels, int& width, int& height) {
+
+    std::ifstream file { file_name + KTX_EXTENSION, std::ios::binary };
+    if (!file.is_open()) return false;
+
+    unsigned char identifier[sizeof(ktx_identifier)] {};
+    ktx_header header {};
+
+    file.read(reinterpret_cast<char*>(identifier), sizeof(identifier));
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    if (!file || std::memcmp(identifier, ktx_identifier, sizeof(identifier)) != 0 || header.endianness != KTX_ENDIANNESS) {
+        std::cerr << "Warning: \"" << file_name << KTX_EXTENSION << "\" isn't a cooked texture; loading the image instead." << std::endl;
+        return false;
+    }
+
+    if (std::find(compressed_formats.begin(), compressed_formats.end(), header.gl_internal_format) == compressed_formats.end()) return false;
+
+    file.ignore(header.bytes_of_key_value_data);
+
+    levels.resize(header.number_of_mipmap_levels);
+
+    for (std::vector<unsigned char>& level : levels) {
+        std::uint32_t size { 0 };
+        file.read(reinterpret_cast<char*>(&size), sizeof(size));
+
+        level.resize(size);
+        file.read(reinterpret_cast<char*>(&level[0]), size);
+    }
+
+    if (!file) {
+        std::cerr << "Warning: cooked texture \"" << file_name << KTX_EXTENSION << "\" is truncated; loading the image instead." << std::endl;
+        return false;
+    }
+
+    internal_format = header.gl_internal_format;
+    width = header.pixel_width;
+    height = header.pixel_height;
+
+    return true;
+}
+
+void texture_streamer::decode(decoded& d, const std::vector<GLenum>& compressed_formats) {
+    std::vector<std::vector<unsigned char>> levels {};
+    int width { 0 };
+    int height { 0 };
+
+    if (read_cooked(d.file_name, compressed_formats, d.internal_format, levels, width, height)) {
+        d.compressed = true;
+
+        for (std::vector<unsigned char>& level : levels) {
+            d.mips.push_back({ width, height, std::move(level) });
+
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+
+        return;
+    }
+
+    stbi_set_flip_vertically_on_load_thread(true);
+
+    int num_channels;
+    unsigned char* image_data = stbi_load(d.file_name.c_str(), &width, &height, &num_channels, 0);
+
+    if (!image_data) {
+        d.error = stbi_failure_reason();
+        return;
+    }
+
+    if (num_channels == 1) {
+        d.internal_format = GL_R8;
+        d.format = GL_RED;
+    } else if (num_channels == 3) {
+        d.internal_format = GL_RGB8;
+        d.format = GL_RGB;
+    } else if (num_channels == 4) {
+        d.internal_format = GL_RGBA8;
+        d.format = GL_RGBA;
+    } else {
+        d.error = "unexpected number of color channels";
+        stbi_image_free(image_data);
+        return;
+    }
+
+    d.mips.push_back({ width, height, std::vector<unsigned char>(image_data, image_data + width * height * num_channels) });
+    stbi_image_free(image_data);
+
+    // Each further mip averages the 2x2 texels of the one before it; odd edges repeat their last texel
+    while (d.mips.back().width > 1 || d.mips.back().height > 1) {
+        const mip& src = d.mips.back();
+        mip dst { std::max(1, src.width / 2), std::max(1, src.height / 2) };
+        dst.data.resize(dst.width * dst.height * num_channels);
+
+        for (int y = 0 ; y < dst.height ; y += 1) {
+            int y0 = std::min(y * 2, src.height - 1);
+            int y1 = std::min(y * 2 + 1, src.height - 1);
+
+            for (int x = 0 ; x < dst.width ; x += 1) {
+                int x0 = std::min(x * 2, src.width - 1);
+                int x1 = std::min(x * 2 + 1, src.width - 1);
+
+                for (int c = 0 ; c < num_channels ; c += 1) {
+                    int sum = src.data[(y0 * src.width + x0) * num_channels + c] + src.data[(y0 * src.width + x1) * num_channels + c]
+                            + src.data[(y1 * src.width + x0) * num_channels + c] + src.data[(y1 * src.width + x1) * num_channels + c];
+
+                    dst.data[(y * dst.width + x) * num_channels + c] = (sum + 2) / 4;
+                }
+            }
+        }
+
+        d.mips.push_back(std::move(dst));
+    }
+}
+
+texture_streamer& texture_stream() {
+    static texture_streamer streamer {};
+    return streamer;
+}
@@ -1,5 +1,7 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <cstring>
 
 #include <glad/glad.h>
 #include "glm/mat4x4.hpp"
@@ -18,6 +20,65 @@ void display_gl_version_info() {
     std::cout << "Texture units: " << texture_units << std::endl;
 }
 
+bool gl_has_clip_control() {
+#ifdef __EMSCRIPTEN__
+    return false;
+#else
+    return GLAD_GL_ARB_clip_control != 0;
+#endif
+}
+
+// BC1 and BC3 come from S3TC, which WebGL exposes as its own extension; BC4 is core on desktop
+bool gl_has_compressed_format(GLenum internal_format) {
+    const char* extension { nullptr };
+
+#ifdef __EMSCRIPTEN__
+    if (internal_format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) extension = "WEBGL_compressed_texture_s3tc";
+    else if (internal_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) extension = "WEBGL_compressed_texture_s3tc";
+    else if (internal_format == GL_COMPRESSED_RED_RGTC1) extension = "EXT_texture_compression_rgtc";
+    else return false;
+
+    GLint count { 0 };
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+    for (int i = 0 ; i < count ; i += 1) {
+        const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (std::strstr(name, extension)) return true;
+    }
+
+    return false;
+#else
+    if (internal_format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) return GLAD_GL_EXT_texture_compression_s3tc != 0;
+    if (internal_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) return GLAD_GL_EXT_texture_compression_s3tc != 0;
+    if (internal_format == GL_COMPRESSED_RED_RGTC1) return true;
+
+    return false;
+#endif
+}
+
+bool gl_has_program_binary() {
+#ifdef __EMSCRIPTEN__
+    return false;
+#else
+    static GLint formats { -1 };
+    if (formats < 0) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+    return formats > 0;
+#endif
+}
+
+bool gl_enable_parallel_shader_compile() {
+#ifdef __EMSCRIPTEN__
+    return false;
+#else
+    if (GLAD_GL_KHR_parallel_shader_compile) glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    else if (GLAD_GL_ARB_parallel_shader_compile) glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+    else return false;
+
+    return true;
+#endif
+}
+
 void clear_gl_errors() {
     while (glGetError() != GL_NO_ERROR) {}
 }
@@ -30,10 +91,6 @@ void process_gl_errors(const char* fn_call, int line_no) {
 }
 
 std::string load_from_file(const std::string& file_name) {
-    std::string result {};
-
-    std::string line {};
-
     std::ifstream file { file_name };
 
     // Make sure the file actually exists
@@ -42,14 +99,11 @@ std::string load_from_file(const std::string& file_name) {
         exit(EXIT_FAILURE);
     }
 
-    while (std::getline(file, line)) {
-        result.append(line)
-              .append("\n");
-    }
-
-    file.close();
+    // Read in one go, rather than line by line
+    std::ostringstream result {};
+    result << file.rdbuf();
 
-    return result;
+    return result.str();
 }
 
 std::string replace_all(const std::string& templ, const std::string& remove, const std::string& insert) {
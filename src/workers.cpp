@@ -0,0 +1,151 @@
+#include <atomic>
+#include <algorithm>
+#include <memory>
+
+#include "workers.h"
+
+workers::workers() {
+#ifndef __EMSCRIPTEN__
+    unsigned int hardware = std::thread::hardware_concurrency();
+    unsigned int num_threads = hardware > 1 ? hardware - 1 : 0;
+
+    for (unsigned int i = 0 ; i < num_threads ; i += 1) {
+        m_threads.emplace_back([this]() { work(); });
+    }
+#endif
+}
+
+workers::~workers() {
+    {
+        std::lock_guard<std::mutex> lock { m_mutex };
+        m_stopping = true;
+    }
+
+    m_wake.notify_all();
+
+    for (std::thread& t : m_threads) t.join();
+}
+
+void workers::submit(std::function<void()> job) {
+    if (m_threads.empty()) {
+        job();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock { m_mutex };
+        m_jobs.push_back(std::move(job));
+    }
+
+    m_wake.notify_one();
+}
+
+void workers::submit_background(std::function<void()> job) {
+    if (m_threads.empty()) {
+        job();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock { m_mutex };
+        m_background.push_back(std::move(job));
+    }
+
+    m_wake.notify_one();
+}
+
+void workers::parallel_for(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)>& fn) {
+    if (count == 0) return;
+
+    grain = std::max<std::size_t>(grain, 1);
+    std::size_t chunks = std::min<std::size_t>((count + grain - 1) / grain, concurrency() * 4);
+
+    if (chunks <= 1 || m_threads.empty()) {
+        fn(0, count);
+        return;
+    }
+
+    // Chunks are claimed in order by whoever gets to them first. Jobs that only run once every chunk has been
+    // claimed find nothing to do, and may do so after this has returned, so the state they share outlives it.
+    struct chunk_state {
+        const std::function<void(std::size_t, std::size_t)>* fn { nullptr };
+        std::size_t count { 0 };
+        std::size_t chunk_size { 0 };
+        std::size_t chunks { 0 };
+
+        std::atomic<std::size_t> next { 0 };
+        std::atomic<std::size_t> remaining { 0 };
+    };
+
+    std::shared_ptr<chunk_state> state = std::make_shared<chunk_state>();
+    state->fn = &fn;
+    state->count = count;
+    state->chunk_size = (count + chunks - 1) / chunks;
+    state->chunks = chunks;
+    state->remaining.store(chunks, std::memory_order_relaxed);
+
+    auto run_chunks = [](chunk_state& s) {
+        for (std::size_t c = s.next.fetch_add(1) ; c < s.chunks ; c = s.next.fetch_add(1)) {
+            std::size_t begin = c * s.chunk_size;
+            std::size_t end = std::min(s.count, begin + s.chunk_size);
+
+            if (begin < end) (*s.fn)(begin, end);
+            s.remaining.fetch_sub(1, std::memory_order_release);
+        }
+    };
+
+    for (std::size_t c = 1 ; c < chunks ; c += 1) {
+        submit([state, run_chunks]() { run_chunks(*state); });
+    }
+
+    run_chunks(*state);
+
+    // Whatever is left is already running on the workers
+    while (state->remaining.load(std::memory_order_acquire) > 0) std::this_thread::yield();
+}
+
+void workers::work() {
+    unsigned int background_limit = std::max<unsigned int>(m_threads.size() - 1, 1);
+
+    while (true) {
+        std::function<void()> job {};
+        bool background { false };
+
+        {
+            std::unique_lock<std::mutex> lock { m_mutex };
+            m_wake.wait(lock, [this, background_limit]() {
+                return m_stopping || !m_jobs.empty() || (!m_background.empty() && m_background_running < background_limit);
+            });
+
+            if (!m_jobs.empty()) {
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+            } else if (!m_background.empty() && m_background_running < background_limit) {
+                job = std::move(m_background.front());
+                m_background.pop_front();
+
+                background = true;
+                m_background_running += 1;
+            } else {
+                return;
+            }
+        }
+
+        job();
+
+        if (background) {
+            {
+                std::lock_guard<std::mutex> lock { m_mutex };
+                m_background_running -= 1;
+            }
+
+            // A thread may have been left waiting on the limit
+            m_wake.notify_one();
+        }
+    }
+}
+
+workers& worker_pool() {
+    static workers pool {};
+    return pool;
+}